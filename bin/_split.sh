@@ -89,7 +89,7 @@ echo -e "${FONT_COLOR_RESET}"
 ##########
 # Config #
 ##########
-declare -a REQUIRED_PROGRAMS=('bax2bam' 'split_primer_from_pbbam' 'pbindex' 'dataset')
+declare -a REQUIRED_PROGRAMS=('bax2bam' 'split_primer_from_pbbam' 'dataset')
 declare -a Inputs=()
 declare -a Names=()
 
@@ -164,25 +164,25 @@ let Step+=1
 echo2 "Begin to split bam files"
 declare -a refarmedBamFiles=()
 if [[ ! -f ${RUNUID}.${Step}.Done || ${RUNUID}.${Step}.Done -ot ${RUNUID}.$((Step-1)).Done ]]; then
+    # all inputs in one run, so that they share one pool of threads
+    declare -a splitArgs=()
+    declare -a splitInputs=()
     for bamFile in "${bamInputs[@]}"; do
         declare Prefix=$(basename ${bamFile%.subreads.bam})
-        # split bam file
-        echo2 "Split ${bamFile}"
-        if ! isFile ${Prefix}.refarm.bam; then
-            split_primer_from_pbbam -p $PrimerSequence -o ${Prefix}.refarm.bam -t ${Threads} ${bamFile} \
-            || echo2 "failed to split bam file ${bamFile}" error
+        if ! isFile ${Prefix}.refarm.bam || ! isFile ${Prefix}.refarm.bam.pbi; then
+            splitArgs+=( -o ${Prefix}.refarm.bam )
+            splitInputs+=( ${bamFile} )
         else
             echo2 "Skipping ${bamFile} because the output ${Prefix}.refarm.bam has existed" warning
         fi
-        # index bam file
-        echo2 "Index ${bamFile}"
-        if ! isFile ${Prefix}.refarm.bam.pbi; then
-            pbindex ${Prefix}.refarm.bam \
-            || echo2 "failed to index bam file ${Prefix}.refarm.bam" error
-        fi
         refarmedBamFiles+=( ${Prefix}.refarm.bam )
-        echo2 "Done with ${bamFile}"
     done # for bamFile in "${bamInputs[@]}";
+    # split bam files, split_primer_from_pbbam writes the .pbi index alongside
+    if [[ ${#splitInputs[@]} -gt 0 ]]; then
+        echo2 "Split ${splitInputs[*]}"
+        split_primer_from_pbbam -p $PrimerSequence -t ${Threads} "${splitArgs[@]}" "${splitInputs[@]}" \
+        || echo2 "failed to split bam files ${splitInputs[*]}" error
+    fi
 fi
 
 if [[ ${Upload} -eq 1 ]]; then
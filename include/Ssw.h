@@ -121,6 +121,21 @@ public:
 
     void CleanReferenceSequence(void);
 
+    // =========
+    // @function Translate the query and build its profile once, for every following
+    //             Align(translated_ref, ...) call to reuse.
+    //           [NOTICE] If there exists a query, that one will be deleted
+    //                    and replaced. Rebuilding or clearing the score matrix
+    //                    deletes it as well, so set it after the matrix.
+    // @param    seq    The query bases;
+    //                  [NOTICE] It is not necessary null terminated.
+    // @param    length The length of bases will be be built.
+    // @return   The length of the built bases.
+    // =========
+    int SetQuerySequence(const char* seq, const int& length);
+
+    void CleanQuerySequence(void);
+
     // =========
     // @function Set penalties for opening and extending gaps
     //           [NOTICE] The defaults are 3 and 1 respectively.
@@ -161,6 +176,20 @@ public:
     bool Align(const char* query, const char* ref, const int& ref_len,
         const Filter& filter, Alignment* alignment, const int32_t maskLen) const;
 
+    // =========
+    // @function Align the query set by SetQuerySequence againt a reference that has
+    //             already been translated by TranslateBases, e.g. one read of a RecordBatch.
+    //           [NOTICE] The reference won't replace the reference
+    //                      set by SetReferenceSequence, and it is not copied.
+    // @param    translated_ref The translated reference sequence.
+    // @param    ref_len        The length of the reference sequence.
+    // @param    filter         The filter for the alignment.
+    // @param    alignment      The container contains the result.
+    // @return   True: succeed; false: fail, also without a query.
+    // =========
+    bool Align(const int8_t* translated_ref, const int32_t& ref_len,
+        const Filter& filter, Alignment* alignment) const;
+
     // @function Clear up all containers and thus the aligner is disabled.
     //             To rebuild the aligner please use Build functions.
     void Clear(void);
@@ -217,6 +246,10 @@ private:
     int8_t* translated_reference_;
     int32_t reference_length_;
 
+    int8_t* translated_query_;
+    int32_t query_length_;
+    s_profile* query_profile_; // built by SetQuerySequence on score_matrix_
+
     int TranslateBase(const char* bases, const int& length, int8_t* translated) const;
     void SetAllDefault(void);
     void BuildDefaultMatrix(void);
@@ -227,6 +260,13 @@ private:
 }; // class Aligner
 
 
+// =========
+// @function Translate bases with the default {A,C,G,T,N} translation,
+//             the one every Aligner built without a custom translation matrix uses.
+// @return   The length of the translated bases.
+// =========
+int TranslateBases(const char* bases, const int& length, int8_t* translated);
+
 // ================
 // inline functions
 // ================
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Where and how well the primer aligns, for --stats-only: histograms of the best and the
+ * best minus next-best score of every aligned read, and of the position of every accepted hit,
+ * both relative to the read length and in bases from the start of the read.
+ *
+ * Every batch fills one in its align stage and the writer adds them up.
+ */
+struct AdapterStats {
+    static constexpr size_t kRelativeBins = 20;    // of 5% of the read each
+    static constexpr int32_t kOffsetBinWidth = 500; // bases
+    static constexpr size_t kOffsetBins = 100;     // the last one takes everything beyond 50 kb
+
+    AdapterStats();
+
+    // make room for scores up to @max_score, keeping the counts
+    void Resize(size_t max_score);
+
+    // zero all counts, keeping the sizes
+    void Clear();
+
+    void AddAlignment(uint16_t sw_score, uint16_t sw_score_next_best);
+
+    void AddHit(int32_t ref_begin, int32_t read_length);
+
+    void Merge(const AdapterStats& other);
+
+    uint64_t aligned;
+    uint64_t hits;
+    uint64_t no_adapter;
+    uint64_t ambiguous;
+    std::vector<uint64_t> sw_score;      // indexed by score
+    std::vector<uint64_t> sw_score_diff; // by best minus next-best
+    std::vector<uint64_t> relative_position;
+    std::vector<uint64_t> offset;
+};
+
+// @counts as a JSON array
+void WriteJsonArray(std::ostream& out, const std::vector<uint64_t>& counts);
+
+// @s as a quoted JSON string, escaped
+void WriteJsonString(std::ostream& out, const std::string& s);
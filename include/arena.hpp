@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Monotonic arena for everything that lives exactly as long as one batch.
+ *
+ * Allocations bump a pointer and are never freed individually; Reset() drops all of them at
+ * once. The memory itself is kept, and after a batch that did not fit into one block the blocks
+ * are merged into a single one as large as that batch, so steady state needs no malloc at all.
+ */
+class MonotonicArena {
+public:
+    explicit MonotonicArena(size_t initial_size = 1 << 20);
+
+    ~MonotonicArena();
+
+    MonotonicArena(const MonotonicArena&) = delete;
+
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    void *Allocate(size_t bytes, size_t alignment);
+
+    void Reset();
+
+    // bytes handed out since the last Reset()
+    size_t Used() const { return used_; }
+
+    // the most bytes handed out between two Reset()s
+    size_t Peak() const { return peak_; }
+
+    // bytes currently held from the system
+    size_t Reserved() const;
+
+private:
+    struct Block {
+        char *data;
+        size_t size;
+    };
+
+    void _add_block(size_t size);
+
+    std::vector<Block> blocks_;
+    size_t current_;
+    size_t offset_;
+    size_t used_;
+    size_t peak_;
+};
+
+template <class T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    template <class U>
+    struct rebind {
+        using other = ArenaAllocator<U>;
+    };
+
+    explicit ArenaAllocator(MonotonicArena& arena) : arena_(&arena) {}
+
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena_) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(arena_->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t) {}
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena_ == other.arena_; }
+
+    template <class U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena_ != other.arena_; }
+
+private:
+    template <class U> friend class ArenaAllocator;
+
+    MonotonicArena *arena_;
+};
+
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pbbam/BamHeader.h>
+#include <pbbam/BamRecord.h>
+#include <pbbam/BamWriter.h>
+#include <pbbam/PbiBuilder.h>
+#include "memory_budget.hpp"
+
+/**
+ * A BamWriter, and optionally its PbiBuilder, on a thread of its own.
+ *
+ * Records are handed over in chunks and written in the order the chunks came in. At most
+ * @max_pending chunks wait at a time, after that Write() blocks until the thread catches up, so
+ * a slow output holds back the pipeline instead of piling up records in memory.
+ */
+class AsyncBamWriter {
+public:
+    AsyncBamWriter(const std::string& file
+                   , const PacBio::BAM::BamHeader& header
+                   , PacBio::BAM::BamWriter::CompressionLevel level
+                   , size_t compression_threads
+                   , bool with_index
+                   , size_t max_pending = 8);
+
+    // writes what is still queued and closes the file
+    ~AsyncBamWriter();
+
+    AsyncBamWriter(const AsyncBamWriter&) = delete;
+
+    AsyncBamWriter& operator=(const AsyncBamWriter&) = delete;
+
+    // the chunk holds @reserved bytes of @budget until it is written, if there is one
+    void Write(std::vector<PacBio::BAM::BamRecord>&& records, MemoryBudget *budget = nullptr, uint64_t reserved = 0);
+
+    // written so far
+    uint64_t NumRecords() const { return num_records_; }
+
+private:
+    struct Chunk {
+        std::vector<PacBio::BAM::BamRecord> records;
+        MemoryBudget *budget;
+        uint64_t reserved;
+    };
+
+    void _run();
+
+    PacBio::BAM::BamWriter writer_;
+    std::unique_ptr<PacBio::BAM::PbiBuilder> index_;
+    const size_t max_pending_;
+    std::deque<Chunk> pending_;
+    std::mutex mx_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    bool done_;
+    std::atomic<uint64_t> num_records_;
+    std::thread thread_;
+};
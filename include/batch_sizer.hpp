@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Picks how many bases go into the next batch.
+ *
+ * Batches are sized by bases rather than records, so that 100 kb subreads and 1 kb CCS reads
+ * cost about the same per batch: by default as many bases as take kDefaultBatchNs of work.
+ * Lock wait is the one signal the pipeline has for batches being too small: when it grows
+ * relative to the actual work, the target time per batch grows; once it is negligible again,
+ * the target goes back towards the default, never below it. Without contention, e.g. with one
+ * reader, one writer and a few workers, the batch time simply stays at the default. Every
+ * change of the target is logged.
+ */
+class AdaptiveBatchSizer {
+public:
+    explicit AdaptiveBatchSizer(uint64_t initial_bases);
+
+    uint64_t TargetBases() const { return target_bases_.load(std::memory_order_relaxed); }
+
+    // feed back one finished batch; lock_wait_ns is the lock wait accumulated since the last call
+    void Update(uint64_t bases, uint64_t work_ns, uint64_t lock_wait_ns);
+
+private:
+    static constexpr uint64_t kMinBases = 10000;
+    static constexpr uint64_t kMaxBases = 500000000;
+    static constexpr double kDefaultBatchNs = 100e6;
+    static constexpr double kMaxBatchNs = 2e9;
+    static constexpr int kWindow = 8; // batches between two decisions
+
+    std::atomic<uint64_t> target_bases_;
+    double ns_per_base_;     // moving average
+    double target_batch_ns_;
+    uint64_t window_work_ns_;
+    uint64_t window_wait_ns_;
+    int window_batches_;
+};
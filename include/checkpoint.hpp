@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <pbbam/BamWriter.h>
+#include <pbbam/PbiBuilder.h>
+
+#include "pipeline.hpp"
+
+// what a run needs to carry on where a previous one stopped
+struct CheckpointState {
+    size_t segments;  // complete segments of every output
+    size_t input;     // input to carry on with
+    int64_t offset;   // virtual offset in that input to carry on from
+    std::vector<std::string> inputs;
+    std::vector<std::string> outputs;
+    std::string settings; // options that change the output, a resumed run has to match them
+};
+
+bool ReadCheckpoint(const std::string& file, CheckpointState& state);
+
+// written to a temporary file and renamed over @file, so that a crash leaves the previous one
+void WriteCheckpoint(const std::string& file, const CheckpointState& state);
+
+/**
+ * Writes every output as a series of segments and checkpoints between them.
+ *
+ * Every output goes to output.seg0, output.seg1, ... Once per interval, between two batches,
+ * all current segments are closed and synced, a checkpoint records how many segments are
+ * complete and where in the input the next batch starts, and the next segments are opened. A
+ * resumed run drops whatever segments came after the checkpoint, seeks the input to its offset
+ * and carries on with the next segment. Finish() concatenates the segments of every output
+ * without recompressing them, so the records of the output are those of an uninterrupted run.
+ */
+class CheckpointedOutputs {
+public:
+    // open the writer, and the index if wanted, of @file, the segment of output @output
+    using OpenFunction = std::function<void(const std::string& file
+                                            , size_t output
+                                            , std::unique_ptr<PacBio::BAM::BamWriter>& writer
+                                            , std::unique_ptr<PacBio::BAM::PbiBuilder>& index)>;
+
+    CheckpointedOutputs(const std::string& checkpoint_file
+                        , const CheckpointState& state
+                        , std::chrono::seconds interval
+                        , bool with_index
+                        , OpenFunction open);
+
+    // point the pipeline's inputs, the first of which is input state.input, to the segments;
+    // @output_of_input maps every input (of all of them) to its output
+    void Bind(std::vector<PipelineInput>& inputs, const std::vector<size_t>& output_of_input);
+
+    // the pipeline's WriteHook
+    void AfterWrite(std::vector<PipelineInput>& inputs, size_t input, int64_t input_offset);
+
+    // close the last segments, put every output together and remove the checkpoint
+    void Finish();
+
+    static std::string SegmentFile(const std::string& output, size_t segment);
+
+private:
+    void _open_segments();
+
+    void _close_segments();
+
+    std::string checkpoint_file_;
+    CheckpointState state_;
+    std::chrono::seconds interval_;
+    std::chrono::steady_clock::time_point last_checkpoint_;
+    bool with_index_;
+    OpenFunction open_;
+    std::vector<size_t> output_of_input_;
+    std::vector<std::unique_ptr<PacBio::BAM::BamWriter>> writers_;
+    std::vector<std::unique_ptr<PacBio::BAM::PbiBuilder>> indices_;
+};
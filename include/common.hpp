@@ -3,6 +3,11 @@
 
 #include <vector>
 #include <sstream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <type_traits>
 #include <boost/utility/string_ref.hpp>
 #include "kernel_color.hpp"
 
@@ -14,10 +19,30 @@
 #define DEFAULT_NUM_THREADS "4"
 #endif
 
+#ifndef DEFAULT_COMPRESSION_THREADS
+#define DEFAULT_COMPRESSION_THREADS "1"
+#endif
+
+#ifndef DEFAULT_COMPRESSION_LEVEL
+#define DEFAULT_COMPRESSION_LEVEL "4"
+#endif
+
 #ifndef DEFAULT_BULK_SIZE
 #define DEFAULT_BULK_SIZE "500"
 #endif
 
+#ifndef DEFAULT_MAX_MEMORY
+#define DEFAULT_MAX_MEMORY "0"
+#endif
+
+#ifndef DEFAULT_MIN_RQ
+#define DEFAULT_MIN_RQ "0"
+#endif
+
+#ifndef DEFAULT_SAMPLE_SEED
+#define DEFAULT_SAMPLE_SEED "0"
+#endif
+
 #ifndef DEFAULT_MIN_LEN_REPORT
 #define DEFAULT_MIN_LEN_REPORT "100"
 #endif
@@ -52,13 +77,62 @@ namespace Utils {
 
 std::vector<StringView> Tokenize(StringView line, char delimiter);
 
+// integers are parsed in place, without going through a stream; false on values that do not fit in T
 template <class T>
-bool StringViewTo(const StringView& s, T& t) {
+typename std::enable_if<std::is_integral<T>::value, bool>::type
+StringViewTo(const StringView& s, T& t) {
+    using U = typename std::make_unsigned<T>::type;
+    if (s.empty()) return false;
+    auto iter = s.cbegin();
+    bool negative = false;
+    if (*iter == '-' || *iter == '+') {
+        negative = *iter == '-';
+        if (negative && std::is_unsigned<T>::value) return false;
+        if (++iter == s.cend()) return false;
+    }
+    // the magnitude of the smallest T is one more than that of the largest
+    const U limit = static_cast<U>(std::numeric_limits<T>::max()) + (negative ? 1 : 0);
+    U ret = 0;
+    for (; iter != s.cend(); ++iter) {
+        if (*iter < '0' || *iter > '9') return false;
+        U digit = static_cast<U>(*iter - '0');
+        if (ret > (limit - digit) / 10) return false;
+        ret = static_cast<U>(ret * 10 + digit);
+    }
+    t = negative && ret ? static_cast<T>(-static_cast<T>(ret - 1) - 1) : static_cast<T>(ret);
+    return true;
+}
+
+template <class T>
+typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+StringViewTo(const StringView& s, T& t) {
+    char buffer[64];
+    if (s.empty() || s.size() >= sizeof(buffer)) return false;
+    std::memcpy(buffer, s.data(), s.size());
+    buffer[s.size()] = '\0';
+    char *end;
+    t = static_cast<T>(std::strtod(buffer, &end));
+    return end == buffer + s.size();
+}
+
+template <class T>
+typename std::enable_if<!std::is_arithmetic<T>::value, bool>::type
+StringViewTo(const StringView& s, T& t) {
     std::istringstream ss(s.to_string());
     ss >> t;
     return ss.fail() ? false : true;
 }
 
+// write the decimal representation of @v to @out without a terminating null, return the number of chars written
+size_t FormatInt(int64_t v, char *out);
+
+// "4096", "512K", "8G", ... to bytes (binary multiples); false if @s is not such a size
+bool ParseByteSize(const StringView& s, uint64_t& bytes);
+
+// bytes in the largest binary unit that keeps at least one digit before the point, e.g. "1.5G"
+std::string FormatByteSize(uint64_t bytes);
+
+void Info(const std::string& s);
 void Warning(const std::string& s);
 void Error(const std::string& s);
 
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <htslib/bgzf.h>
+#include "common.hpp"
+
+enum class OutputFormat {
+    BAM,
+    FASTA,
+    FASTQ
+};
+
+// bam, fasta or fastq
+bool ParseOutputFormat(StringView s, OutputFormat& format);
+
+const char *OutputFormatName(OutputFormat format);
+
+// from the extension of @file: .fa, .fasta, .fq or .fastq, each optionally followed by .gz;
+// anything else is BAM
+OutputFormat OutputFormatOfFile(const std::string& file);
+
+bool IsGzipped(const std::string& file);
+
+// one record, its name, its sequence and, for FASTQ, qualities as FASTQ characters of the same length
+void AppendFastx(std::string& out, OutputFormat format, StringView name, StringView sequence, StringView qualities);
+
+/**
+ * A FASTA or FASTQ file, written from text that is already formatted.
+ *
+ * Gzipped output is written as BGZF, which every gzip reader takes, and compressed by htslib's
+ * own thread pool; plain output goes through a large stdio buffer. "-" writes to stdout.
+ */
+class FastxWriter {
+public:
+    FastxWriter(const std::string& file, bool gzipped, int level, size_t compression_threads);
+
+    ~FastxWriter();
+
+    FastxWriter(const FastxWriter&) = delete;
+
+    FastxWriter& operator=(const FastxWriter&) = delete;
+
+    void Write(StringView text);
+
+private:
+    static constexpr size_t kBufferSize = 4 << 20;
+
+    std::string file_;
+    BGZF *bgzf_;  // gzipped output
+    FILE *plain_; // otherwise
+};
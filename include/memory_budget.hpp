@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Byte budget shared by every stage of the pipeline.
+ *
+ * The reader reserves the estimated footprint of a batch before handing it on, together with the
+ * most the workers can build from it, and the writer gives it back once the batch is written;
+ * the part held by copies queued for an AsyncBamWriter goes back when that writer has written
+ * them. The reader does not start a new batch while the budget is exhausted, so the memory in
+ * flight stays within the limit plus at most one batch. A limit of 0 means no limit; the usage
+ * is still tracked.
+ */
+class MemoryBudget {
+public:
+    explicit MemoryBudget(uint64_t limit);
+
+    MemoryBudget(const MemoryBudget&) = delete;
+
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    // never blocks; admission is decided by Exhausted() before a batch is read
+    void Reserve(uint64_t bytes);
+
+    void Release(uint64_t bytes);
+
+    bool Exhausted() const { return limit_ && used_.load(std::memory_order_relaxed) >= limit_; }
+
+    uint64_t Limit() const { return limit_; }
+
+    uint64_t Used() const { return used_.load(std::memory_order_relaxed); }
+
+    uint64_t Peak() const { return peak_.load(std::memory_order_relaxed); }
+
+private:
+    const uint64_t limit_;
+    std::atomic<uint64_t> used_;
+    std::atomic<uint64_t> peak_;
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * Concatenate split outputs, e.g. of --shard 0/N .. N-1/N, without recompressing them.
+ *
+ * The inputs must carry the same read groups. The output gets the header of the first input,
+ * followed by the BGZF blocks of every input's records copied byte for byte, with the EOF
+ * marker each input ends with dropped; only the closing EOF block is written anew. The inputs'
+ * .pbi indices, when @with_index, are merged by moving every file offset by where its input's
+ * blocks ended up in the output.
+ */
+void MergeBams(const std::vector<std::string>& inputs, const std::string& output, bool with_index);
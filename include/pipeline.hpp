@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <pbbam/BamReader.h>
+#include <pbbam/BamRecord.h>
+#include <pbbam/BamWriter.h>
+#include <pbbam/PbiBuilder.h>
+
+#include "async_writer.hpp"
+#include "batch_sizer.hpp"
+#include "fastx.hpp"
+#include "memory_budget.hpp"
+#include "scheduler.hpp"
+#include "sidecar.hpp"
+#include "splitter.hpp"
+#include "threads.hpp"
+
+/**
+ * The split as a graph of per-batch tasks on a work-stealing pool:
+ *
+ *   read -> decode -> align -> build -> write
+ *
+ * read and write run one at a time, read in input order and write in the same order, so the
+ * output does not depend on the scheduling; decode, align and build of different batches run
+ * on whichever workers are free. With an adaptive batch size, the writer feeds the time each
+ * batch took and the lock waits back into the AdaptiveBatchSizer the reader asks before every
+ * batch. Every batch in flight holds its estimated footprint in a MemoryBudget, including the most
+ * its build stage can add, from the moment it is read; the reader parks while the budget is
+ * exhausted and the writer resumes it as batches come back. BGZF
+ * compression of the output happens in the writer's own htslib threads behind the write stage,
+ * and the write stage adds every record to the .pbi index with the offset the writer gives it,
+ * which is only final with a single compression thread, so indexed runs are held to one.
+ * FASTA and FASTQ output is formatted by the build stage, the write stage only hands the text
+ * of the batch to the FastxWriter.
+ * Reads that are not split go to the AsyncBamWriter of their category, if there is one. The split
+ * reads themselves have no such thread: they are written by the write stage, whose hook
+ * (checkpoints) and batch recycling rely on a batch being written when the stage returns. With
+ * SplitterOptions::keep_unsplit they are also written to the output in between the split reads, in input order,
+ * straight from the records they were read into: their tags are never decoded and nothing is
+ * rebuilt, so writing them costs little more than copying the serialized record.
+ *
+ * With a CpuTopology the workers are pinned in one group per NUMA node and every node has a
+ * pool of batches of its own, allocated by a thread on that node. A batch stays on the node
+ * whose pool it came from from decode to build; read and write run on the nodes closest to the
+ * input and the output.
+ *
+ * A sidecar of every read's alignment is written by the write stage, in input order; one read
+ * back is handed out by the reader stage, a row per record, and takes the place of the aligner.
+ *
+ * With SplitterOptions::stats_only nothing is cut or written: the align stage fills the batch's
+ * AdapterStats, the build stage has nothing to do and the write stage only adds them up.
+ *
+ * With a sweep grid, the build stage also works out what every point of the grid would give for
+ * the batch, from the same alignments, and the writer adds that up.
+ *
+ * The align stage triages every read first: a read that cannot give any output, because of its
+ * length, its rq or its composition, is counted under the rule that ruled it out and is never
+ * aligned.
+ *
+ * With SplitterOptions::by_zmw, the reader cuts batches between ZMWs only, so that the align
+ * stage sees all subreads of a ZMW together.
+ *
+ * Several inputs run through the same pipeline one after the other: the reader moves on to the
+ * next input as soon as the current one is exhausted, so the last batches of one input are
+ * still being aligned while the first of the next are read. Every batch remembers its input and
+ * is written to that input's writer, which may be shared by all inputs for a merged output.
+ * With a topology, the reader runs on the node of the input it is reading and the writer on the
+ * node of the output of the next batch to write.
+ */
+struct PipelineInput;
+
+// called by the write stage after every batch, while no other batch is being written, with the
+// input the batch came from and the virtual offset in it right after the batch's last record;
+// may swap the writers and indices of @inputs, e.g. to start a new output segment
+using WriteHook = std::function<void(std::vector<PipelineInput>& inputs, size_t input, int64_t input_offset)>;
+
+struct PipelineOptions {
+    size_t num_threads;
+    size_t batch_size;
+    bool adaptive_batch_size;
+    uint64_t max_memory;          // bytes, 0 for no limit
+    const CpuTopology *topology;  // null for unpinned workers
+    WriteHook after_write; // empty for none
+    AsyncBamWriter *category_writers[NUM_READ_CATEGORIES]; // unsplit reads by category, null for none
+    SidecarWriter *sidecar_out; // every read's alignment, null for none
+    SidecarReader *sidecar_in;  // the alignments of an earlier run to use instead of aligning, null for none
+    const std::vector<SweepPoint> *sweep; // thresholds to evaluate every alignment at, null for none
+};
+
+struct PipelineInput {
+    PacBio::BAM::BamReader *reader;
+    PacBio::BAM::BamWriter *writer;
+    PacBio::BAM::PbiBuilder *index; // null to write no .pbi
+    FastxWriter *fastx; // for FASTA/FASTQ output, in place of writer and index
+    // the NUMA nodes closest to the input and the output file, where the reader and the writer run
+    // while this input is read and written; 0 without a topology
+    size_t reader_node;
+    size_t writer_node;
+};
+
+class Pipeline {
+public:
+    using queue_type = MultiThreadSafeQueue<RecordBatch, PacBio::BAM::BamRecord>;
+    using pool_type = BatchPool<Batch>;
+
+    // the inputs are read in this order
+    Pipeline(const std::vector<PipelineInput>& inputs
+             , const SplitterOptions& options
+             , const PipelineOptions& pipeline_options
+            );
+
+    void Run();
+
+    // summed over the per-node pools
+    size_t PeakBatchesInFlight() const;
+
+    size_t NumBatches() const;
+
+    uint64_t RecordsIn() const { return records_in_; }
+
+    uint64_t BasesIn() const { return bases_in_; }
+
+    uint64_t PeakMemory() const { return budget_.Peak(); }
+
+    uint64_t WindowHits() const { return window_hits_; }
+
+    uint64_t RescuedHits() const { return rescued_hits_; }
+
+    uint64_t Triaged(TriageRule rule) const { return triaged_[rule]; }
+
+    // with SplitterOptions::stats_only
+    const AdapterStats& Stats() const { return stats_; }
+
+    // one per point of PipelineOptions::sweep
+    const std::vector<SweepStats>& SweepStatistics() const { return sweep_stats_; }
+
+private:
+    // the nodes of the input being read and of input @input, within the pool's nodes
+    size_t _reader_node() const;
+
+    size_t _writer_node(size_t input) const;
+
+    void _read();
+
+    void _decode(Batch *batch);
+
+    void _align(size_t worker, Batch *batch);
+
+    void _build(size_t worker, Batch *batch);
+
+    void _enqueue_write(Batch *batch);
+
+    void _write();
+
+    // in adaptive mode batches are cut by bases, this only keeps them from growing without bound
+    static constexpr size_t kAdaptiveMaxRecords = 1 << 16;
+    // 500 subreads of 10 kb, where the fixed size mode starts
+    static constexpr uint64_t kAdaptiveInitialBases = 5000000;
+    // rough footprint of one input base once its batch is decoded and built, used to keep a
+    // single batch from taking more than its share of the memory budget
+    static constexpr uint64_t kBatchBytesPerBase = 10;
+
+    const SplitterOptions& options_;
+    std::vector<PipelineInput> inputs_;
+    std::vector<std::unique_ptr<queue_type>> queues_; // one per input
+    size_t current_input_; // only touched by the reader
+    WorkStealingPool workers_;
+    std::vector<std::unique_ptr<BamSplitter>> splitters_; // one per worker
+    std::vector<std::unique_ptr<pool_type>> batches_; // one per node
+    std::unique_ptr<AdaptiveBatchSizer> sizer_; // null when batches have a fixed size
+    MemoryBudget budget_;
+    size_t max_batch_bases_;
+    WriteHook after_write_;
+    AsyncBamWriter *category_writers_[NUM_READ_CATEGORIES];
+    SidecarWriter *sidecar_out_;
+    SidecarReader *sidecar_in_; // only touched by the reader
+    const std::vector<SweepPoint> *sweep_;
+
+    std::mutex mx_;
+    std::atomic<uint64_t> lock_wait_ns_;
+    uint64_t reported_lock_wait_ns_;
+    bool reading_;
+    bool eof_;
+    uint64_t next_read_;
+    bool writing_;
+    uint64_t next_write_;
+    uint64_t records_in_; // counted by the writer
+    uint64_t bases_in_;
+    uint64_t window_hits_;
+    uint64_t rescued_hits_;
+    uint64_t triaged_[NUM_TRIAGE_RULES];
+    std::vector<SweepStats> sweep_stats_; // summed by the writer
+    AdapterStats stats_; // likewise
+    std::map<uint64_t, Batch *> ready_; // built batches waiting for their turn to be written
+};
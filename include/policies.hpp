@@ -5,6 +5,7 @@
 #include <deque>
 #include <pbbam/BamReader.h>
 #include <pbbam/BamRecord.h>
+#include "record_batch.hpp"
 
 template <class T>
 struct LinearContainerPolicies;
@@ -44,6 +45,57 @@ struct LinearContainerPolicies<std::vector<Args...> > {
         c.emplace_bacK(std::forward<TT>(args)...);
     }
 
+    static value_type& Grow(container_type& c) {
+        c.emplace_back();
+        return c.back();
+    }
+
+    static void Shrink(container_type& c) {
+        c.pop_back();
+    }
+
+};
+
+template <class... Args>
+struct LinearContainerPolicies<RecordBatch<Args...> > {
+
+    using container_type = RecordBatch<Args...>;
+    using value_type = typename container_type::value_type;
+    using reference = typename container_type::reference;
+    using iterator = typename container_type::iterator;
+    using const_iterator = typename container_type::const_iterator;
+    using size_type = typename container_type::size_type;
+
+    static void Reserve(container_type& c, size_type s) {
+        c.reserve(s);
+    }
+
+    static size_type Capacity(const container_type& c) {
+        return c.capacity();
+    }
+
+    static const value_type& At(const container_type& c, size_type idx) {
+        return c[idx];
+    }
+
+    static void Push(container_type& c, value_type&& val) {
+        c.push_back(std::forward<value_type>(val));
+    }
+
+    template <class... TT>
+    static void Push(container_type& c, TT&& ... args) {
+        c.emplace_back(std::forward<TT>(args)...);
+    }
+
+    // hands out a recycled record, so reading into it reuses its buffers
+    static value_type& Grow(container_type& c) {
+        return c.Grow();
+    }
+
+    static void Shrink(container_type& c) {
+        c.Shrink();
+    }
+
 };
 
 // TODO: add policies for other containers
@@ -63,4 +115,24 @@ struct DataProducerPolicy<PacBio::BAM::BamRecord> {
         return std::make_pair(d, success);
     }
 
+    // read straight into an existing record, whose storage is reused
+    bool ProduceInto(source_type& s, data_type& d) {
+        return s.GetNext(d);
+    }
+
+    // what a record weighs when batches are sized by work rather than by count
+    size_t Cost(const data_type& d) const {
+        return d.Impl().SequenceLength();
+    }
+
+    // where the next record will be read from, a BGZF virtual offset
+    int64_t Position(source_type& s) const {
+        return s.VirtualTell();
+    }
+
+    // subreads of the same ZMW, which a batch of whole ZMWs is not cut between
+    bool SameGroup(const data_type& a, const data_type& b) const {
+        return a.HasHoleNumber() && b.HasHoleNumber() && a.HoleNumber() == b.HoleNumber();
+    }
+
 };
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "common.hpp"
+
+/**
+ * movie/zmw/qs_qe for subreads, movie/zmw/ccs (or movie/zmw/ccs/fwd and /rev for by-strand
+ * reads) for CCS reads
+ *
+ * Parsing only takes views into the original name and formatting writes into a fixed buffer,
+ * so neither of them touches the heap.
+ */
+struct SubreadName {
+    StringView movie;
+    int32_t zmw;
+    int32_t qs;
+    int32_t qe;
+    StringView ccs; // what follows the zmw of a CCS read, empty for subreads; qs and qe are 0 then
+};
+
+bool ParseSubreadName(StringView name, SubreadName& parsed);
+
+class SubreadNameFormatter {
+public:
+    // a zmw and two positions plus a movie name of up to 220 characters, longer ones are an error
+    static constexpr size_t kBufferSize = 256;
+
+    StringView Format(StringView movie, int32_t zmw, int32_t qs, int32_t qe);
+
+    // movie/zmw/ccs/begin_end, with positions in the CCS read
+    StringView FormatCcs(StringView movie, int32_t zmw, StringView ccs, int32_t begin, int32_t end);
+
+private:
+    char buffer_[kBufferSize];
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <pbbam/BamRecord.h>
+#include <pbbam/Tag.h>
+#include "common.hpp"
+
+// EditTag() only changes a tag that is already there
+void SetTag(PacBio::BAM::BamRecordImpl& impl, const std::string& name, const PacBio::BAM::Tag& value);
+
+/**
+ * Holds everything of one read that has to be cut together with its sequence.
+ *
+ * The sequence is decoded once per read, by the RecordBatch the read comes from; the tags are
+ * only decoded when the read is actually sliced, once, and sorted into per-read tags (np, rq, sn,
+ * zm, RG, barcodes...), which every segment gets as they are, and per-base tags (kinetics, RS II
+ * QV strings, any other array as long as the read), which are cut along with the sequence.
+ * Per-pulse data of internal-mode BAMs (pc, pa, pm, pd, px, pt, pv...) cannot be cut without the
+ * pulse-to-base mapping and is dropped, as is a per-base tag whose length does not match.
+ *
+ * A segment is built from an empty record under the read's header, its cut sequence and all its
+ * tags in one go, so the full-length kinetics of the read are never copied into a segment. This is
+ * not a byte slice: pbbam gives no access to the raw bam1_t, so the tags go through Tag.
+ */
+class ReadSlicer {
+public:
+    ReadSlicer();
+
+    // start over with a new read from input @input of the pipeline, keeping the capacity of all
+    // buffers; @sequence has to stay valid until the next Reset()
+    void Reset(const PacBio::BAM::BamRecord& record, StringView sequence, size_t input);
+
+    StringView Sequence() const { return sequence_; }
+
+    uint8_t LocalContext() const { return cx_; }
+
+    // turn @outbam into [begin, end) of the current read, with the read's per-read tags and its
+    // per-base tags cut to the segment
+    void Slice(PacBio::BAM::BamRecord& outbam, int begin, int end);
+
+    // the same for a CCS read: the base qualities are cut along with the sequence, and the
+    // per-base tags, the kinetics HiFi reads mostly come without anyway, are dropped instead of cut
+    void SliceCcs(PacBio::BAM::BamRecord& outbam, int begin, int end);
+
+private:
+    struct PerBaseTag {
+        std::string name;
+        bool reversed; // stored in the orientation of the reverse strand, e.g. ccs ri/rp
+        PacBio::BAM::TagDataType type;
+        std::vector<int8_t> i8;
+        std::vector<uint8_t> u8;
+        std::vector<int16_t> i16;
+        std::vector<uint16_t> u16;
+        std::vector<int32_t> i32;
+        std::vector<uint32_t> u32;
+        std::vector<float> f;
+        std::string str;
+    };
+
+    void _load_tags();
+
+    // @outbam as the segment [begin, end) of the current read, without any tags yet
+    void _start_segment(PacBio::BAM::BamRecord& outbam, int begin, int end, const char *qualities);
+
+    static PacBio::BAM::Tag _slice(const PerBaseTag& tag, int begin, int end);
+
+    const PacBio::BAM::BamRecord *record_;
+    StringView sequence_;
+    uint8_t cx_;
+    bool loaded_;
+    PacBio::BAM::TagCollection per_read_;
+    std::vector<PerBaseTag> per_base_;
+    PacBio::BAM::TagCollection tags_; // of the segment being built, its nodes reused
+    size_t blank_input_; // input whose header blank_ has, SIZE_MAX before the first read
+    PacBio::BAM::BamRecord blank_; // unmapped, no name, sequence or tags
+    bool qualities_loaded_;
+    std::string qualities_; // FASTQ characters, empty if the read has none
+};
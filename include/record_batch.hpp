@@ -0,0 +1,267 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Ssw.h"
+#include "read_name.hpp"
+
+template <class T, size_t Alignment>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <class U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template <class U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T *allocate(size_t n) {
+        void *p = nullptr;
+        if (posix_memalign(&p, Alignment, n * sizeof(T)) != 0) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(p);
+    }
+
+    void deallocate(T *p, size_t) { free(p); }
+
+    template <class U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+
+    template <class U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+/**
+ * A batch of records laid out for the alignment stage.
+ *
+ * The records themselves are only read in while the producer holds the queue lock. Decode(),
+ * called by the worker afterwards, lays every sequence of the batch end to end in one buffer,
+ * together with its pre-translated copy in a cache line aligned buffer, and keeps zmw, qs, qe
+ * and movie of every record in a separate array, so the aligner walks contiguous memory
+ * instead of chasing pointers into the records. Subreads take them from their zm, qs and qe
+ * tags and the movie of their read group; only records without those tags have their name
+ * read and parsed.
+ *
+ * clear() only forgets the contents: input records, output records and buffers all keep their
+ * storage, so a batch that is recycled through a BatchPool reads the next records into the
+ * very same memory.
+ */
+template <class Record>
+class RecordBatch {
+public:
+    using value_type = Record;
+    using reference = Record&;
+    using const_reference = const Record&;
+    using iterator = typename std::vector<Record>::iterator;
+    using const_iterator = typename std::vector<Record>::const_iterator;
+    using size_type = typename std::vector<Record>::size_type;
+
+    struct Meta {
+        // the full name in names_, or only the movie for a record read from its tags
+        size_t name_offset;
+        size_t name_length;
+        bool from_tags;
+        bool parsed;
+        SubreadName name; // movie and ccs point into names_, fixed up at the end of Decode()
+    };
+
+    RecordBatch()
+        : size_(0)
+          , num_outputs_(0) {}
+
+    void reserve(size_type n) {
+        records_.reserve(n);
+        meta_.reserve(n);
+        offsets_.reserve(n + 1);
+    }
+
+    size_type capacity() const { return records_.capacity(); }
+
+    size_type size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    void push_back(Record&& r) { Grow() = std::move(r); }
+
+    template <class... Args>
+    void emplace_back(Args&& ... args) { Grow() = Record(std::forward<Args>(args)...); }
+
+    // one more record at the end, reusing a slot from an earlier round if there is one
+    Record& Grow() {
+        if (size_ == records_.size()) {
+            records_.emplace_back();
+        }
+        return records_[size_++];
+    }
+
+    // give back the record handed out by the last Grow()
+    void Shrink() { --size_; }
+
+    void clear() {
+        size_ = 0;
+        num_outputs_ = 0;
+        meta_.clear();
+        offsets_.clear();
+        bases_.clear();
+        codes_.clear();
+        names_.clear();
+        read_groups_.clear();
+    }
+
+    void swap(RecordBatch& other) {
+        records_.swap(other.records_);
+        std::swap(size_, other.size_);
+        outputs_.swap(other.outputs_);
+        std::swap(num_outputs_, other.num_outputs_);
+        meta_.swap(other.meta_);
+        offsets_.swap(other.offsets_);
+        bases_.swap(other.bases_);
+        codes_.swap(other.codes_);
+        names_.swap(other.names_);
+        read_groups_.swap(other.read_groups_);
+    }
+
+    iterator begin() { return records_.begin(); }
+
+    iterator end() { return records_.begin() + size_; }
+
+    const_iterator begin() const { return records_.begin(); }
+
+    const_iterator end() const { return records_.begin() + size_; }
+
+    Record& operator[](size_type i) { return records_[i]; }
+
+    const Record& operator[](size_type i) const { return records_[i]; }
+
+    // a record to build output into, recycled the same way as the input records
+    Record& NewOutput() {
+        if (num_outputs_ == outputs_.size()) {
+            outputs_.emplace_back();
+        }
+        return outputs_[num_outputs_++];
+    }
+
+    size_type NumOutputs() const { return num_outputs_; }
+
+    const Record& Output(size_type i) const { return outputs_[i]; }
+
+    // lay out sequences, translated sequences and names of all records
+    void Decode();
+
+    StringView Sequence(size_type i) const {
+        return StringView(bases_.data() + offsets_[i], offsets_[i + 1] - offsets_[i]);
+    }
+
+    const int8_t *Codes(size_type i) const { return codes_.data() + offsets_[i]; }
+
+    int32_t Length(size_type i) const { return static_cast<int32_t>(offsets_[i + 1] - offsets_[i]); }
+
+    uint64_t TotalBases() const { return offsets_.empty() ? 0 : offsets_.back(); }
+
+    // heap bytes held by the decoded layout, the records themselves not included
+    size_t BufferBytes() const {
+        return meta_.capacity() * sizeof(Meta) + offsets_.capacity() * sizeof(uint64_t)
+            + bases_.capacity() + codes_.capacity() + names_.capacity()
+            + read_groups_.capacity() * sizeof(ReadGroupMovie);
+    }
+
+    const Meta& Metadata(size_type i) const { return meta_[i]; }
+
+private:
+    // the movie of a read group in names_, looked up in the header once per batch
+    struct ReadGroupMovie {
+        std::string id;
+        size_t movie_offset;
+        size_t movie_length;
+        bool subreads;
+    };
+
+    // the read group of @r, if it is one of subreads, whose zm, qs and qe can stand in for the name
+    const ReadGroupMovie *SubreadGroup(const Record& r);
+
+    std::vector<Record> records_;
+    size_type size_;
+    std::vector<Record> outputs_;
+    size_type num_outputs_;
+    std::vector<Meta> meta_;
+    std::vector<uint64_t> offsets_;
+    std::string bases_;
+    std::vector<int8_t, AlignedAllocator<int8_t, 64>> codes_;
+    std::string names_;
+    std::vector<ReadGroupMovie> read_groups_;
+};
+
+template <class Record>
+const typename RecordBatch<Record>::ReadGroupMovie *RecordBatch<Record>::SubreadGroup(const Record& r) {
+    if (!r.HasHoleNumber() || !r.HasQueryStart() || !r.HasQueryEnd()) return nullptr;
+    auto id = r.ReadGroupId();
+    if (id.empty()) return nullptr;
+    for (const auto& group : read_groups_) {
+        if (group.id == id) return group.subreads ? &group : nullptr;
+    }
+    ReadGroupMovie group{id, names_.size(), 0, false};
+    auto header = r.Header();
+    if (header.HasReadGroup(id)) {
+        auto read_group = header.ReadGroup(id);
+        // CCS reads keep their name for the ccs part of it
+        group.subreads = read_group.ReadType() == "SUBREAD" && !read_group.MovieName().empty();
+        if (group.subreads) {
+            names_ += read_group.MovieName();
+            group.movie_length = names_.size() - group.movie_offset;
+        }
+    }
+    read_groups_.push_back(std::move(group));
+    return read_groups_.back().subreads ? &read_groups_.back() : nullptr;
+}
+
+template <class Record>
+void RecordBatch<Record>::Decode() {
+    meta_.clear();
+    offsets_.clear();
+    bases_.clear();
+    names_.clear();
+    read_groups_.clear();
+    offsets_.push_back(0);
+    for (const auto& r : *this) {
+        // pbbam hands out the packed bases only as a string of their own
+        bases_ += r.Impl().Sequence();
+        offsets_.push_back(bases_.size());
+        Meta m;
+        const auto *group = SubreadGroup(r);
+        m.from_tags = group != nullptr;
+        if (m.from_tags) {
+            m.name_offset = group->movie_offset;
+            m.name_length = group->movie_length;
+            m.name.zmw = r.HoleNumber();
+            m.name.qs = r.QueryStart();
+            m.name.qe = r.QueryEnd();
+        } else {
+            m.name_offset = names_.size();
+            names_ += r.FullName();
+            m.name_length = names_.size() - m.name_offset;
+        }
+        meta_.push_back(m);
+    }
+    codes_.resize(bases_.size());
+    StripedSmithWaterman::TranslateBases(bases_.data(), static_cast<int>(bases_.size()), codes_.data());
+    // names_ does not move any more, views into it are safe from here on
+    for (auto& m : meta_) {
+        StringView name(names_.data() + m.name_offset, m.name_length);
+        if (m.from_tags) {
+            m.name.movie = name;
+            m.name.ccs = StringView();
+            m.parsed = true;
+        } else {
+            m.parsed = ParseSubreadName(name, m.name);
+        }
+    }
+}
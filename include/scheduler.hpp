@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "topology.hpp"
+
+/**
+ * Thread pool in which every worker has its own task deque.
+ *
+ * A task submitted from inside the pool goes to the back of the submitting worker's deque and
+ * is picked up from there again first, so a batch tends to stay on the core that has it in
+ * cache. A worker without work of its own steals from the front of the others, which is how an
+ * idle core ends up helping whichever stage is the bottleneck at the moment.
+ *
+ * Given a CpuTopology, the workers are split into one group per NUMA node, each worker pinned
+ * to its own core of that node. Tasks can then be submitted to a node, and a worker steals from
+ * its own group before it crosses over to another node.
+ */
+class WorkStealingPool {
+public:
+    // a task is told the index of the worker that runs it
+    using Task = std::function<void(size_t)>;
+
+    static constexpr size_t kAnyNode = static_cast<size_t>(-1);
+
+    // unpinned workers when @topology is null
+    explicit WorkStealingPool(size_t num_workers, const CpuTopology *topology = nullptr);
+
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // @node is a hint: the task goes to a worker of that node, but may still be stolen; tasks for
+    // a node without workers are treated as kAnyNode
+    void Submit(Task task, size_t node = kAnyNode);
+
+    // block until no task is queued or running any more
+    void Wait();
+
+    size_t Size() const { return queues_.size(); }
+
+    size_t NumNodes() const { return node_workers_.size(); }
+
+    size_t WorkersOnNode(size_t node) const { return node_workers_[node].size(); }
+
+private:
+    struct TaskQueue {
+        std::mutex mx;
+        std::deque<Task> tasks;
+    };
+
+    void _run(size_t id);
+
+    bool _pop(size_t id, Task& task);
+
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::vector<std::thread> workers_;
+    std::vector<int> cpu_of_;                       // -1 for an unpinned worker
+    std::vector<size_t> node_of_;
+    std::vector<std::vector<size_t>> node_workers_; // workers of every node
+    std::mutex mx_;
+    std::condition_variable work_cv_;
+    std::condition_variable idle_cv_;
+    std::atomic<size_t> queued_; // counted before the task is pushed, so it never goes below zero
+    std::atomic<size_t> pending_; // queued + running
+    std::atomic<size_t> next_queue_;
+    bool stop_;
+};
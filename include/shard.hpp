@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <pbbam/PbiFilter.h>
+#include <pbbam/PbiRawData.h>
+#include <vector>
+
+#include "common.hpp"
+
+// ZMWs with hole numbers in [begin, end); an end of INT32_MAX has no upper bound, so that hole
+// number INT32_MAX is not left out
+struct ZmwRange {
+    int32_t begin;
+    int32_t end;
+};
+
+// how much of an input a random sample of its ZMWs covers
+struct ZmwSample {
+    uint64_t zmws;
+    uint64_t records;
+    uint64_t sampled_zmws;
+    uint64_t sampled_records;
+};
+
+/**
+ * Pieces of one subreads.bam for splitting on several nodes.
+ *
+ * Subreads come sorted by ZMW, so a ZMW range is a contiguous stretch of the file that a
+ * PbiIndexedBamReader reaches with a single seek. Shards never cut through a ZMW, and
+ * concatenating the outputs of shards 0 .. N-1 in order gives the output of the whole file.
+ */
+namespace Shard {
+
+// "i/N" with 0 <= i < N
+bool ParseShard(const StringView& s, size_t& shard, size_t& num_shards);
+
+// "first-last", both inclusive, as hole numbers are written everywhere else
+bool ParseZmwRange(const StringView& s, ZmwRange& range);
+
+// shards and ranges rely on subreads being sorted by hole number
+bool SortedByZmw(const PacBio::BAM::PbiRawData& index);
+
+// the ZMWs of shard @shard out of @num_shards with about the same number of subreads each
+ZmwRange ShardRange(const PacBio::BAM::PbiRawData& index, size_t shard, size_t num_shards);
+
+PacBio::BAM::PbiFilter RangeFilter(const ZmwRange& range);
+
+/**
+ * The sorted hole numbers of @num_zmws ZMWs, or of @fraction of them when @num_zmws is 0, drawn
+ * at random from all ZMWs in @index; the same @seed draws the same ZMWs on every machine.
+ * Adds the sizes of the input and of the sample to @sample.
+ */
+std::vector<int32_t> SampleZmws(const PacBio::BAM::PbiRawData& index
+                                , double fraction
+                                , size_t num_zmws
+                                , uint64_t seed
+                                , ZmwSample& sample);
+
+// the subreads of @zmws, sorted hole numbers; a PbiIndexedBamReader seeks from one to the next
+PacBio::BAM::PbiFilter ZmwFilter(const std::vector<int32_t>& zmws);
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "splitter.hpp"
+
+/**
+ * The alignment of the primer to every read of a run, written next to the output so that -m,
+ * -f and -l can be applied again later without aligning anything.
+ *
+ * Layout, native byte order:
+ *
+ *   header: "SPLITSC1", uint32 match, mismatch, gap open and gap extension score, uint32 primer
+ *           length, the primer, zero padding to a multiple of 8
+ *   blocks: uint64 number of rows n, then every column as an array of n values: int32 zmw,
+ *           int32 qs, int32 qe, uint16 sw_score, uint16 sw_score_next_best, int32 ref_begin,
+ *           int32 ref_end, each array padded with zeros to a multiple of 8 bytes
+ *
+ * Rows are in the order the reads were read, one block per batch. Every column of a block is
+ * a plain array at an aligned offset, so a mapped sidecar is read in place.
+ */
+class SidecarWriter {
+public:
+    SidecarWriter(const std::string& file, const SplitterOptions& options);
+
+    ~SidecarWriter();
+
+    SidecarWriter(const SidecarWriter&) = delete;
+
+    SidecarWriter& operator=(const SidecarWriter&) = delete;
+
+    void Append(const SidecarRow *rows, size_t n);
+
+private:
+    template <class T>
+    void _write_column(const SidecarRow *rows, size_t n, T SidecarRow::*column);
+
+    void _write(const void *data, size_t bytes);
+
+    std::string file_;
+    FILE *out_;
+    std::vector<char> column_; // one column of the block being written
+};
+
+class SidecarReader {
+public:
+    // maps @file and checks that its alignments were made with the scoring of @options
+    SidecarReader(const std::string& file, const SplitterOptions& options);
+
+    ~SidecarReader();
+
+    SidecarReader(const SidecarReader&) = delete;
+
+    SidecarReader& operator=(const SidecarReader&) = delete;
+
+    // the next row in read order, false after the last one
+    bool Next(SidecarRow& row);
+
+    uint64_t RowsRead() const { return rows_read_; }
+
+private:
+    // move on to the block at offset_, false at the end of the file
+    bool _load_block();
+
+    std::string file_;
+    const char *data_;
+    size_t size_;
+    size_t offset_; // of the next block
+    uint64_t block_rows_;
+    uint64_t block_row_; // next row of the current block
+    const int32_t *zmw_;
+    const int32_t *qs_;
+    const int32_t *qe_;
+    const uint16_t *sw_score_;
+    const uint16_t *sw_score_next_best_;
+    const int32_t *ref_begin_;
+    const int32_t *ref_end_;
+    uint64_t rows_read_;
+};
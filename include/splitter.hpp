@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <pbbam/BamRecord.h>
+
+#include "Ssw.h"
+#include "adapter_stats.hpp"
+#include "arena.hpp"
+#include "fastx.hpp"
+#include "read_name.hpp"
+#include "read_slicer.hpp"
+#include "record_batch.hpp"
+#include "sweep.hpp"
+
+// why a read is not split
+enum ReadCategory {
+    NO_ADAPTER = 0, // best score below -m
+    AMBIGUOUS,      // best minus next-best score below -f
+    NUM_READ_CATEGORIES
+};
+
+// why a read is not aligned at all
+enum TriageRule {
+    // the hit of both rules scores -m, or the 3/4 of it --by-zmw rescues
+    TRIAGE_LENGTH = 0,  // too short to leave a segment longer than -l next to a hit scoring -m
+    TRIAGE_RQ,          // read quality below --min-rq
+    TRIAGE_COMPOSITION, // lacks the bases a hit scoring -m would have to match
+    NUM_TRIAGE_RULES
+};
+
+struct SplitterOptions {
+    std::string primer_seq;
+    uint16_t min_sw_score;
+    uint16_t min_sw_diff;
+    uint8_t match_score;
+    uint8_t mismatch_penalty;
+    uint8_t gap_open_penalty;
+    uint8_t gap_ext_penalty;
+    int min_len;
+    bool verbose;
+    bool keep_unsplit; // the reads without an accepted hit go to the output as they are
+    bool by_zmw; // batches of whole ZMWs, whose subreads share the adapter position of strong hits
+    bool ccs; // CCS reads: movie/zmw/ccs names, qualities cut along, no subread tags or kinetics
+    float min_rq; // reads with a lower rq tag are not aligned, 0 to align all
+    bool keep_alignments; // keep the alignment of every read in Batch::alignments, for a sidecar or a sweep
+    bool from_sidecar; // take the alignments from Batch::alignments instead of aligning
+    bool stats_only; // only fill Batch::stats, Build() cuts nothing
+    OutputFormat format; // for FASTA and FASTQ, Build() formats text instead of building records
+    bool keep_category[NUM_READ_CATEGORIES]; // note the reads of a category for an output of their own
+};
+
+// what is kept of the alignment of the primer to one read of a batch
+struct AdapterHit {
+    size_t index;
+    uint16_t sw_score;
+    uint16_t sw_score_next_best;
+    int32_t ref_begin;
+    int32_t ref_end;
+    uint8_t num_outputs; // records Build() cut from the read, 0 to 2, in hit order among the batch's outputs
+};
+
+// one read's alignment as kept in a sidecar, see sidecar.hpp
+struct SidecarRow {
+    int32_t zmw; // -1 if the name does not parse
+    int32_t qs;
+    int32_t qe;
+    uint16_t sw_score;
+    uint16_t sw_score_next_best;
+    int32_t ref_begin;
+    int32_t ref_end;
+};
+
+struct RejectedRead {
+    size_t index;
+    ReadCategory category;
+};
+
+/**
+ * One batch in flight, together with everything derived from it on its way through the pipeline.
+ *
+ * Whatever only lives as long as the batch is allocated from its own arena, which is reset when
+ * the batch goes back to the pool.
+ */
+struct Batch {
+    RecordBatch<PacBio::BAM::BamRecord> records;
+    MonotonicArena arena;
+    ArenaVector<AdapterHit> hits;
+    ArenaVector<RejectedRead> rejected; // only the categories asked for in SplitterOptions
+    ArenaVector<SidecarRow> alignments; // one per read, with SplitterOptions::keep_alignments or from_sidecar
+    ArenaVector<size_t> below_rq; // reads --min-rq ruled out although they have a row in alignments
+    std::string text; // the output as FASTA or FASTQ, in place of the output records
+    std::vector<SweepStats> sweep; // with a sweep grid, what the batch gives at every point of it
+    AdapterStats stats; // with SplitterOptions::stats_only
+    uint64_t seq; // position of the batch in the input, the writer keeps this order
+    size_t input; // which of the pipeline's inputs the records come from
+    int64_t input_offset; // virtual offset in that input right after the last record
+    uint64_t work_ns; // time spent on the batch in decode, align and build
+    uint64_t reserved_bytes; // taken from the pipeline's MemoryBudget, given back by the writer
+    uint32_t window_hits; // with by_zmw, hits found in the window a sibling subread pointed to
+    uint32_t rescued; // and borderline hits taken because a sibling had a strong one there
+    uint32_t triaged[NUM_TRIAGE_RULES]; // reads the triage kept from the aligner, by rule
+    size_t node; // NUMA node of the pool the batch belongs to, kept across clear()
+
+    Batch();
+
+    Batch(const Batch&) = delete;
+
+    Batch& operator=(const Batch&) = delete;
+
+    void reserve(size_t n) { records.reserve(n); }
+
+    // estimated heap footprint of the input and output records plus the batch's own buffers
+    uint64_t EstimatedBytes() const;
+
+    // EstimatedBytes() of a batch just read, plus the most the build stage can add to it: the two
+    // segments of every read, its copy for a category output, or its FASTA or FASTQ text
+    uint64_t WorstCaseBytes() const;
+
+    // estimated heap footprint of one record
+    static uint64_t RecordBytes(const PacBio::BAM::BamRecord& r);
+
+    void clear();
+};
+
+/**
+ * The per-worker state of the align and build stages: aligner, scoring matrix and the buffers
+ * used to cut reads. Stages of the same batch may run on different workers, so nothing
+ * batch-specific is kept in here.
+ */
+class BamSplitter {
+public:
+    explicit BamSplitter(const SplitterOptions& options);
+
+    BamSplitter(const BamSplitter&) = delete;
+
+    BamSplitter& operator=(const BamSplitter&) = delete;
+
+    // align the primer to every read of the batch and keep the hits that pass -m and -f, and
+    // the reads that fail them if their category is kept; with by_zmw, a strong hit in one
+    // subread narrows the search in the following subreads of its ZMW and rescues borderline
+    // hits near the same position; a hit found in that window is tested for -f against the
+    // next-best hit of the window only, a second adapter elsewhere in the read does not make it
+    // ambiguous
+    void Align(Batch& batch);
+
+    // a rule that rules out any output from read @index of @data without aligning it, or
+    // NUM_TRIAGE_RULES if the read has to be aligned; --min-rq always applies, the length and
+    // composition rules only save aligning and are left out without @bounds
+    TriageRule Triage(const RecordBatch<PacBio::BAM::BamRecord>& data, size_t index, bool bounds) const;
+
+    // cut the reads that have a hit into output records, or straight into FASTA/FASTQ text
+    void Build(Batch& batch);
+
+private:
+    void _prepare_scoring_matrix(int8_t *scoring_matrix);
+
+    // Align() from the alignments a sidecar had for the batch
+    void _replay(Batch& batch);
+
+    // the batch's stats, sized for the primer, with stats_only; null otherwise
+    AdapterStats *_stats(Batch& batch) const;
+
+    static void _count_rejected(AdapterStats& stats, ReadCategory category);
+
+    // align the primer to the whole of read @index of @batch into alignment_, and keep the
+    // alignment with keep_alignments
+    void _align_read(Batch& batch, size_t index);
+
+    // [begin, end) of read @index of @batch as a FASTA/FASTQ record named @name
+    void _append_fastx(Batch& batch, size_t index, StringView name, int begin, int end);
+
+    const SplitterOptions& options_;
+    StripedSmithWaterman::Aligner aligner_;
+    StripedSmithWaterman::Filter filter_;
+    StripedSmithWaterman::Alignment alignment_;
+    ReadSlicer read_;
+    SubreadNameFormatter formatter_;
+    std::string name_buffer_;
+    int32_t min_split_length_; // shorter reads cannot hold a hit scoring min_hit_score_ and a segment
+    uint16_t min_hit_score_; // the lowest score a hit is taken with: -m, or what by_zmw rescues
+    uint32_t primer_counts_[5]; // A, C, G, T and N in the primer
+    size_t qualities_of_; // read whose qualities are in qualities_, SIZE_MAX for none
+    std::string qualities_;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SidecarRow;
+
+// one combination of -m, -f and -l
+struct SweepPoint {
+    uint16_t min_sw_score;
+    uint16_t min_sw_diff;
+    int32_t min_len;
+};
+
+// what the split would have given with one SweepPoint
+struct SweepStats {
+    uint64_t reads;
+    uint64_t no_adapter; // best score below -m
+    uint64_t ambiguous;  // best minus next-best below -f
+    uint64_t too_short;  // a hit, but no segment longer than -l
+    uint64_t split;      // at least one segment
+    uint64_t segments;
+    uint64_t bases_kept; // in the segments
+};
+
+/**
+ * Evaluates a grid of thresholds against alignments that are made only once.
+ *
+ * The grid file has one combination per line, "-m -f -l" separated by blanks; empty lines and
+ * lines starting with # are skipped. Every read is aligned once, whatever the size of the grid,
+ * and every combination is then decided from the same SidecarRow, the same way Align() and
+ * Build() decide it for the thresholds given on the command line.
+ */
+namespace Sweep {
+
+std::vector<SweepPoint> ReadGrid(const std::string& file);
+
+// add what @n reads with alignments @rows give at every point of @grid to @stats, leaving out
+// the @num_excluded reads whose ascending indices are at @excluded, which --min-rq ruled out
+void Evaluate(const std::vector<SweepPoint>& grid
+              , const SidecarRow *rows
+              , size_t n
+              , const size_t *excluded
+              , size_t num_excluded
+              , std::vector<SweepStats>& stats);
+
+void Add(const std::vector<SweepStats>& from, std::vector<SweepStats>& to);
+
+// one tab-separated line per point, with a header line
+void WriteReport(const std::string& file, const std::vector<SweepPoint>& grid, const std::vector<SweepStats>& stats);
+
+}
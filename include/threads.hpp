@@ -1,9 +1,37 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 #include "policies.hpp"
 
+// std::lock_guard that also adds the time spent waiting for the mutex to a counter
+class TimedLockGuard {
+public:
+    TimedLockGuard(std::mutex& mx, std::atomic<uint64_t>& wait_ns)
+        : mx_(mx) {
+        auto start = std::chrono::steady_clock::now();
+        mx_.lock();
+        wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+    ~TimedLockGuard() { mx_.unlock(); }
+
+    TimedLockGuard(const TimedLockGuard&) = delete;
+
+    TimedLockGuard& operator=(const TimedLockGuard&) = delete;
+
+private:
+    std::mutex& mx_;
+};
+
 template <template <class...> class Container, class T>
 class MultiThreadSafeQueue
   : private LinearContainerPolicies<Container<T>>
@@ -15,10 +43,16 @@ private:
     using container_policies::Reserve;
     using container_policies::Push;
     using container_policies::Capacity;
+    using container_policies::Grow;
+    using container_policies::Shrink;
 
     using producer_policies = DataProducerPolicy<T>;
     using source_type = typename producer_policies::source_type;
     using producer_policies::Produce;
+    using producer_policies::ProduceInto;
+    using producer_policies::Cost;
+    using producer_policies::SameGroup;
+    using producer_policies::Position;
 
 public:
     using container_type = typename container_policies::container_type;
@@ -29,18 +63,28 @@ private:
     source_type& source_;
     container_type data_;
     std::mutex mx_;
+    std::atomic<uint64_t> lock_wait_ns_;
     size_type size_;
     size_type capacity_;
+    value_type carry_; // first element of the next group, read past the end of the last batch
+    bool has_carry_;
+    int64_t carry_position_; // where carry_ was read from
 public:
     explicit MultiThreadSafeQueue(source_type& s, size_type cap)
       : source_(s)
+        , lock_wait_ns_(0)
         , size_(0)
-        , capacity_(cap) {
+        , capacity_(cap)
+        , has_carry_(false)
+        , carry_position_(0) {
         Reserve(data_, capacity_);
     }
 
     size_type Capacity() const { return capacity_; }
 
+    // total time callers of FillAndPop(container_type&) spent waiting for the queue
+    uint64_t LockWaitNanos() const { return lock_wait_ns_; }
+
     template <class... Args>
     void Fill(Args&& ... args);
 
@@ -48,6 +92,16 @@ public:
 
     template <class... Args>
     container_type FillAndPop(Args&& ... args);
+
+    // fill @out, which keeps its storage, instead of handing out a new container, up to
+    // Capacity() elements or until their total Cost() reaches @max_cost; with @whole_groups,
+    // carry on past that until the end of the group of the last element (see SameGroup());
+    // return false once the source is exhausted
+    bool FillAndPop(container_type& out, size_t max_cost = SIZE_MAX, bool whole_groups = false);
+
+    // where the source continues after the last element FillAndPop(container_type&) handed out;
+    // with a carried element that is where it was read from, not where the source stands
+    int64_t Position();
 };
 
 template <template <class...> class Container, class T>
@@ -89,3 +143,124 @@ auto MultiThreadSafeQueue<Container, T>::FillAndPop(Args&& ... args) -> containe
     size_ = 0;
     return newdata;
 };
+
+
+template <template <class...> class Container, class T>
+bool MultiThreadSafeQueue<Container, T>::FillAndPop(container_type& out, size_t max_cost, bool whole_groups) {
+    out.clear();
+    TimedLockGuard lock(mx_, lock_wait_ns_);
+    size_t cost = 0;
+    if (size_) {
+        // hand over what Fill() has already read
+        data_.swap(out);
+        size_ = 0;
+        for (const auto& d : out) {
+            cost += Cost(d);
+        }
+    }
+    if (has_carry_) {
+        // swapped rather than moved, so that both keep a usable record
+        auto& d = Grow(out);
+        std::swap(d, carry_);
+        has_carry_ = false;
+        cost += Cost(d);
+    }
+    for (;;) {
+        bool full = !out.empty() && (out.size() >= capacity_ || cost >= max_cost);
+        if (full && !whole_groups) break;
+        // only a record read past a full batch can become the carry
+        int64_t position = full ? Position(source_) : 0;
+        auto& d = Grow(out);
+        if (!ProduceInto(source_, d)) {
+            Shrink(out);
+            break;
+        }
+        if (full && !SameGroup(out[out.size() - 2], d)) {
+            // starts the next batch
+            std::swap(d, carry_);
+            has_carry_ = true;
+            carry_position_ = position;
+            Shrink(out);
+            break;
+        }
+        cost += Cost(d);
+    }
+    return !out.empty();
+};
+
+template <template <class...> class Container, class T>
+int64_t MultiThreadSafeQueue<Container, T>::Position() {
+    TimedLockGuard lock(mx_, lock_wait_ns_);
+    return has_carry_ ? carry_position_ : Position(source_);
+};
+
+
+/**
+ * A fixed set of batches that cycle reader -> worker -> writer -> reader.
+ *
+ * Batches are never destroyed while the pipeline runs, so whatever storage they and their
+ * records grew stays around for the next round, and the number of batches in flight can
+ * never exceed the size of the pool.
+ */
+template <class Batch>
+class BatchPool {
+public:
+    BatchPool(size_t num_batches, size_t batch_capacity)
+        : in_flight_(0)
+          , peak_in_flight_(0) {
+        for (size_t i = 0; i < num_batches; ++i) {
+            batches_.emplace_back(new Batch());
+            batches_.back()->reserve(batch_capacity);
+            free_.push_back(batches_.back().get());
+        }
+    }
+
+    // block until a batch is available
+    Batch *Acquire() {
+        std::unique_lock<std::mutex> lock(mx_);
+        cv_.wait(lock, [this] { return !free_.empty(); });
+        auto *b = free_.back();
+        free_.pop_back();
+        if (++in_flight_ > peak_in_flight_) {
+            peak_in_flight_ = in_flight_;
+        }
+        return b;
+    }
+
+    // nullptr if all batches are in flight
+    Batch *TryAcquire() {
+        std::lock_guard<std::mutex> lock(mx_);
+        if (free_.empty()) return nullptr;
+        auto *b = free_.back();
+        free_.pop_back();
+        if (++in_flight_ > peak_in_flight_) {
+            peak_in_flight_ = in_flight_;
+        }
+        return b;
+    }
+
+    void Release(Batch *b) {
+        {
+            std::lock_guard<std::mutex> lock(mx_);
+            b->clear();
+            free_.push_back(b);
+            --in_flight_;
+        }
+        cv_.notify_one();
+    }
+
+    size_t Size() const { return batches_.size(); }
+
+    size_t PeakInFlight() const {
+        std::lock_guard<std::mutex> lock(mx_);
+        return peak_in_flight_;
+    }
+
+private:
+    std::vector<std::unique_ptr<Batch>> batches_;
+    std::vector<Batch *> free_;
+    mutable std::mutex mx_;
+    std::condition_variable cv_;
+    size_t in_flight_;
+    size_t peak_in_flight_;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * NUMA layout of the cpus this process is allowed to run on, read from sysfs.
+ *
+ * Nodes without any allowed cpu (memory-only nodes, or cpus excluded by the affinity mask the
+ * process was started with) are left out, so every node has at least one cpu. Without NUMA
+ * information all allowed cpus form a single node.
+ */
+class CpuTopology {
+public:
+    static CpuTopology Detect();
+
+    size_t NumNodes() const { return cpus_.size(); }
+
+    const std::vector<int>& Cpus(size_t node) const { return cpus_[node]; }
+
+    // node closest to the block device that holds @path, or 0 if sysfs does not tell;
+    // a file that does not exist yet is looked up by its directory
+    size_t NodeOfPath(const std::string& path) const;
+
+    std::string ToString() const;
+
+private:
+    std::vector<std::vector<int>> cpus_; // allowed cpus of every node
+    std::vector<int> node_ids_;          // sysfs id of every node
+};
+
+// pin the calling thread to @cpu, false if the kernel refused
+bool PinCurrentThread(int cpu);
@@ -121,6 +121,9 @@ int CalculateNumberMismatch(
     StripedSmithWaterman::Alignment *al, int8_t const *ref, int8_t const *query, const int& query_len
                            ) {
 
+    // without a cigar there is nothing to count or to rewrite
+    if (al->cigar.empty()) return 0;
+
     ref += al->ref_begin;
     query += al->query_begin;
     int mismatch_length = 0;
@@ -229,7 +232,10 @@ Aligner::Aligner(void)
       , gap_opening_penalty_(3)
       , gap_extending_penalty_(1)
       , translated_reference_(NULL)
-      , reference_length_(0) {
+      , reference_length_(0)
+      , translated_query_(NULL)
+      , query_length_(0)
+      , query_profile_(NULL) {
     BuildDefaultMatrix();
 }
 
@@ -248,7 +254,10 @@ Aligner::Aligner(
       , gap_opening_penalty_(gap_opening_penalty)
       , gap_extending_penalty_(gap_extending_penalty)
       , translated_reference_(NULL)
-      , reference_length_(0) {
+      , reference_length_(0)
+      , translated_query_(NULL)
+      , query_length_(0)
+      , query_profile_(NULL) {
     BuildDefaultMatrix();
 }
 
@@ -266,7 +275,10 @@ Aligner::Aligner(const int8_t *score_matrix
       , gap_opening_penalty_(3)
       , gap_extending_penalty_(1)
       , translated_reference_(NULL)
-      , reference_length_(0) {
+      , reference_length_(0)
+      , translated_query_(NULL)
+      , query_length_(0)
+      , query_profile_(NULL) {
     score_matrix_ = new int8_t[score_matrix_size_ * score_matrix_size_];
     memcpy(score_matrix_, score_matrix, sizeof(int8_t) * score_matrix_size_ * score_matrix_size_);
     translation_matrix_ = new int8_t[translation_matrix_size];
@@ -274,7 +286,10 @@ Aligner::Aligner(const int8_t *score_matrix
 }
 
 
-Aligner::Aligner(Aligner&& other) {
+Aligner::Aligner(Aligner&& other)
+    : translated_query_(NULL)
+      , query_length_(0)
+      , query_profile_(NULL) {
     if (this != &other) {
         std::swap(score_matrix_, other.score_matrix_);
         score_matrix_size_ = other.score_matrix_size_;
@@ -284,6 +299,9 @@ Aligner::Aligner(Aligner&& other) {
         gap_extending_penalty_ = other.gap_extending_penalty_;
         std::swap(translated_reference_, other.translated_reference_);
         reference_length_ = other.reference_length_;
+        std::swap(translated_query_, other.translated_query_);
+        std::swap(query_length_, other.query_length_);
+        std::swap(query_profile_, other.query_profile_);
     }
 }
 
@@ -297,6 +315,9 @@ Aligner& Aligner::operator=(Aligner&& other) {
     gap_extending_penalty_ = other.gap_extending_penalty_;
     std::swap(translated_reference_, other.translated_reference_);
     reference_length_ = other.reference_length_;
+    std::swap(translated_query_, other.translated_query_);
+    std::swap(query_length_, other.query_length_);
+    std::swap(query_profile_, other.query_profile_);
     return *this;
 }
 
@@ -328,6 +349,25 @@ int Aligner::SetReferenceSequence(const char *seq, const int& length) {
 
 }
 
+int Aligner::SetQuerySequence(const char *seq, const int& length) {
+    CleanQuerySequence();
+    if (!translation_matrix_ || length == 0) return 0;
+    translated_query_ = new int8_t[length];
+    query_length_ = TranslateBase(seq, length, translated_query_);
+    // the profile points into translated_query_ and score_matrix_
+    const int8_t score_size = 2;
+    query_profile_ = ssw_init(translated_query_, query_length_, score_matrix_, score_matrix_size_, score_size);
+    return query_length_;
+}
+
+void Aligner::CleanQuerySequence(void) {
+    if (query_profile_) init_destroy(query_profile_);
+    query_profile_ = NULL;
+    delete[] translated_query_;
+    translated_query_ = NULL;
+    query_length_ = 0;
+}
+
 int Aligner::TranslateBase(const char *bases, const int& length, int8_t *translated) const {
 
     const char *ptr = bases;
@@ -433,6 +473,43 @@ bool Aligner::Align(const char *query
     return true;
 }
 
+bool Aligner::Align(const int8_t *translated_ref
+                    , const int32_t& ref_len
+                    , const Filter& filter
+                    , Alignment *alignment
+                   ) const {
+    if (!query_profile_) return false;
+    if (ref_len == 0) return false;
+
+    int32_t maskLen = query_length_;
+    if (maskLen > 30) {
+        maskLen = maskLen / 2;
+    } else {
+        maskLen = 15;
+    }
+
+    uint8_t flag = 0;
+    SetFlag(filter, &flag);
+    s_align *s_al = ssw_align(query_profile_
+                              , translated_ref
+                              , ref_len
+                              , static_cast<int>(gap_opening_penalty_)
+                              , static_cast<int>(gap_extending_penalty_)
+                              , flag
+                              , filter.score_filter
+                              , filter.distance_filter
+                              , maskLen);
+
+    alignment->Clear();
+    ConvertAlignment(*s_al, query_length_, alignment);
+    alignment->mismatches = CalculateNumberMismatch(&*alignment, translated_ref, translated_query_, query_length_);
+
+    // Free memory
+    align_destroy(s_al);
+
+    return true;
+}
+
 void Aligner::Clear(void) {
     ClearMatrices();
     CleanReferenceSequence();
@@ -510,6 +587,9 @@ void Aligner::BuildDefaultMatrix(void) {
 }
 
 void Aligner::ClearMatrices(void) {
+    // the query profile is built on the score matrix
+    CleanQuerySequence();
+
     delete[] score_matrix_;
     score_matrix_ = NULL;
 
@@ -517,6 +597,13 @@ void Aligner::ClearMatrices(void) {
     translation_matrix_ = NULL;
 }
 
+int TranslateBases(const char *bases, const int& length, int8_t *translated) {
+    for (int i = 0; i < length; ++i) {
+        translated[i] = kBaseTranslation[static_cast<unsigned char>(bases[i]) & 0x7f];
+    }
+    return length;
+}
+
 uint8_t Aligner::GetMatchScore() const {
     return match_score_;
 }
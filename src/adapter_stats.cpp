@@ -0,0 +1,100 @@
+#include "adapter_stats.hpp"
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+
+constexpr size_t AdapterStats::kRelativeBins;
+constexpr int32_t AdapterStats::kOffsetBinWidth;
+constexpr size_t AdapterStats::kOffsetBins;
+
+AdapterStats::AdapterStats()
+    : aligned(0)
+      , hits(0)
+      , no_adapter(0)
+      , ambiguous(0)
+      , relative_position(kRelativeBins, 0)
+      , offset(kOffsetBins, 0) {}
+
+void AdapterStats::Resize(size_t max_score) {
+    if (sw_score.size() < max_score + 1) {
+        sw_score.resize(max_score + 1, 0);
+        sw_score_diff.resize(max_score + 1, 0);
+    }
+}
+
+void AdapterStats::Clear() {
+    aligned = 0;
+    hits = 0;
+    no_adapter = 0;
+    ambiguous = 0;
+    for (auto *v : {&sw_score, &sw_score_diff, &relative_position, &offset}) {
+        fill(v->begin(), v->end(), 0);
+    }
+}
+
+void AdapterStats::AddAlignment(uint16_t score, uint16_t next_best) {
+    ++aligned;
+    // a score beyond what a perfect match gives only comes from a sidecar of another primer
+    ++sw_score[min<size_t>(score, sw_score.size() - 1)];
+    auto diff = score > next_best ? score - next_best : 0;
+    ++sw_score_diff[min<size_t>(diff, sw_score_diff.size() - 1)];
+}
+
+void AdapterStats::AddHit(int32_t ref_begin, int32_t read_length) {
+    ++hits;
+    if (read_length > 0) {
+        auto bin = static_cast<size_t>(int64_t(ref_begin) * int64_t(kRelativeBins) / read_length);
+        ++relative_position[min(bin, kRelativeBins - 1)];
+    }
+    ++offset[min(static_cast<size_t>(max(ref_begin, 0) / kOffsetBinWidth), kOffsetBins - 1)];
+}
+
+void AdapterStats::Merge(const AdapterStats& other) {
+    aligned += other.aligned;
+    hits += other.hits;
+    no_adapter += other.no_adapter;
+    ambiguous += other.ambiguous;
+    Resize(other.sw_score.empty() ? 0 : other.sw_score.size() - 1);
+    for (size_t i = 0; i < other.sw_score.size(); ++i) {
+        sw_score[i] += other.sw_score[i];
+        sw_score_diff[i] += other.sw_score_diff[i];
+    }
+    for (size_t i = 0; i < kRelativeBins; ++i) {
+        relative_position[i] += other.relative_position[i];
+    }
+    for (size_t i = 0; i < kOffsetBins; ++i) {
+        offset[i] += other.offset[i];
+    }
+}
+
+void WriteJsonArray(ostream& out, const vector<uint64_t>& counts) {
+    out << '[';
+    for (size_t i = 0; i < counts.size(); ++i) {
+        if (i) out << ", ";
+        out << counts[i];
+    }
+    out << ']';
+}
+
+void WriteJsonString(ostream& out, const string& s) {
+    out << '"';
+    for (auto c : s) {
+        switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\t': out << "\\t"; break;
+            case '\r': out << "\\r"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out << escaped;
+                } else {
+                    out << c;
+                }
+        }
+    }
+    out << '"';
+}
@@ -0,0 +1,69 @@
+#include "arena.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+MonotonicArena::MonotonicArena(size_t initial_size)
+    : current_(0)
+      , offset_(0)
+      , used_(0)
+      , peak_(0) {
+    _add_block(initial_size);
+}
+
+MonotonicArena::~MonotonicArena() {
+    for (auto& b : blocks_) {
+        free(b.data);
+    }
+}
+
+void MonotonicArena::_add_block(size_t size) {
+    auto *p = static_cast<char *>(malloc(size));
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    blocks_.push_back(Block{p, size});
+}
+
+void *MonotonicArena::Allocate(size_t bytes, size_t alignment) {
+    for (;;) {
+        auto& b = blocks_[current_];
+        auto base = reinterpret_cast<uintptr_t>(b.data);
+        auto aligned = (base + offset_ + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+        auto end = aligned - base + bytes;
+        if (end <= b.size) {
+            used_ += end - offset_;
+            offset_ = end;
+            peak_ = std::max(peak_, used_);
+            return reinterpret_cast<void *>(aligned);
+        }
+        used_ += b.size - offset_;
+        if (++current_ == blocks_.size()) {
+            _add_block(std::max(b.size * 2, bytes + alignment));
+        }
+        offset_ = 0;
+    }
+}
+
+void MonotonicArena::Reset() {
+    if (blocks_.size() > 1) {
+        auto total = Reserved();
+        for (auto& b : blocks_) {
+            free(b.data);
+        }
+        blocks_.clear();
+        _add_block(total);
+    }
+    current_ = 0;
+    offset_ = 0;
+    used_ = 0;
+}
+
+size_t MonotonicArena::Reserved() const {
+    size_t total = 0;
+    for (const auto& b : blocks_) {
+        total += b.size;
+    }
+    return total;
+}
@@ -0,0 +1,67 @@
+#include "async_writer.hpp"
+
+using namespace std;
+using namespace PacBio::BAM;
+
+AsyncBamWriter::AsyncBamWriter(const string& file
+                               , const BamHeader& header
+                               , BamWriter::CompressionLevel level
+                               , size_t compression_threads
+                               , bool with_index
+                               , size_t max_pending)
+    : writer_(file, header, level, compression_threads, BamWriter::BinCalculation_OFF)
+      , index_(with_index ? new PbiBuilder(file + ".pbi"
+                                           , PbiBuilder::CompressionLevel::CompressionLevel_4
+                                           , compression_threads) : nullptr)
+      , max_pending_(max_pending)
+      , done_(false)
+      , num_records_(0)
+      , thread_(&AsyncBamWriter::_run, this) {}
+
+AsyncBamWriter::~AsyncBamWriter() {
+    {
+        lock_guard<mutex> lock(mx_);
+        done_ = true;
+    }
+    not_empty_.notify_one();
+    thread_.join();
+    if (index_) index_->Close();
+}
+
+void AsyncBamWriter::Write(vector<BamRecord>&& records, MemoryBudget *budget, uint64_t reserved) {
+    if (records.empty()) {
+        if (budget) budget->Release(reserved);
+        return;
+    }
+    {
+        unique_lock<mutex> lock(mx_);
+        not_full_.wait(lock, [this] { return pending_.size() < max_pending_; });
+        pending_.push_back(Chunk{move(records), budget, reserved});
+    }
+    not_empty_.notify_one();
+}
+
+void AsyncBamWriter::_run() {
+    for (;;) {
+        Chunk chunk;
+        {
+            unique_lock<mutex> lock(mx_);
+            not_empty_.wait(lock, [this] { return done_ || !pending_.empty(); });
+            if (pending_.empty()) return;
+            chunk = move(pending_.front());
+            pending_.pop_front();
+        }
+        not_full_.notify_one();
+        int64_t offset;
+        for (const auto& r : chunk.records) {
+            if (index_) {
+                writer_.Write(r, &offset);
+                index_->AddRecord(r, offset);
+            } else {
+                writer_.Write(r);
+            }
+        }
+        num_records_ += chunk.records.size();
+        if (chunk.budget) chunk.budget->Release(chunk.reserved);
+    }
+}
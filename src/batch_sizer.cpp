@@ -0,0 +1,54 @@
+#include "batch_sizer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include "common.hpp"
+
+constexpr uint64_t AdaptiveBatchSizer::kMinBases;
+constexpr uint64_t AdaptiveBatchSizer::kMaxBases;
+constexpr double AdaptiveBatchSizer::kDefaultBatchNs;
+constexpr double AdaptiveBatchSizer::kMaxBatchNs;
+constexpr int AdaptiveBatchSizer::kWindow;
+
+AdaptiveBatchSizer::AdaptiveBatchSizer(uint64_t initial_bases)
+    : target_bases_(initial_bases)
+      , ns_per_base_(0)
+      , target_batch_ns_(kDefaultBatchNs)
+      , window_work_ns_(0)
+      , window_wait_ns_(0)
+      , window_batches_(0) {}
+
+void AdaptiveBatchSizer::Update(uint64_t bases, uint64_t work_ns, uint64_t lock_wait_ns) {
+    if (bases == 0) return;
+    auto sample = static_cast<double>(work_ns) / bases;
+    ns_per_base_ = ns_per_base_ == 0 ? sample : 0.8 * ns_per_base_ + 0.2 * sample;
+    window_work_ns_ += work_ns;
+    window_wait_ns_ += lock_wait_ns;
+    if (++window_batches_ < kWindow) return;
+
+    // more than 2% of the work spent waiting on locks: batches are too small to amortise the
+    // hand-over; below 0.5% a grown target can come back down, to shorten the tail at the end of
+    // the input and the memory each batch holds, but no lower than the default: a lack of wait
+    // says nothing about smaller batches being any better
+    auto wait_ratio = window_work_ns_ ? static_cast<double>(window_wait_ns_) / window_work_ns_ : 0.0;
+    if (wait_ratio > 0.02) {
+        target_batch_ns_ = std::min(target_batch_ns_ * 1.5, kMaxBatchNs);
+    } else if (wait_ratio < 0.005) {
+        target_batch_ns_ = std::max(target_batch_ns_ * 0.8, kDefaultBatchNs);
+    }
+    window_work_ns_ = 0;
+    window_wait_ns_ = 0;
+    window_batches_ = 0;
+
+    auto wanted = static_cast<uint64_t>(target_batch_ns_ / ns_per_base_);
+    wanted = std::max(kMinBases, std::min(kMaxBases, wanted));
+    auto current = TargetBases();
+    // only bother for changes of more than 10%
+    if (wanted * 10 > current * 11 || wanted * 11 < current * 10) {
+        target_bases_.store(wanted, std::memory_order_relaxed);
+        char message[128];
+        snprintf(message, sizeof(message), "adaptive batch size: %lu bases (%.0f ms per batch, lock wait %.1f%% of work)"
+                 , static_cast<unsigned long>(wanted), target_batch_ns_ / 1e6, wait_ratio * 100);
+        Utils::Info(message);
+    }
+}
@@ -0,0 +1,179 @@
+#include "checkpoint.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include "common.hpp"
+#include "merge.hpp"
+
+using namespace std;
+using namespace PacBio::BAM;
+
+namespace {
+
+constexpr char kCheckpointHeader[] = "# split_primer_from_pbbam checkpoint v1";
+
+// closing a file does not put it on disk; a checkpoint is only as good as what it points to
+void SyncFile(const string& file) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
+}
+
+bool FileExists(const string& file) { return access(file.c_str(), F_OK) == 0; }
+
+}
+
+bool ReadCheckpoint(const string& file, CheckpointState& state) {
+    ifstream in(file);
+    string line;
+    if (!in || !getline(in, line) || line != kCheckpointHeader) return false;
+    state = CheckpointState();
+    bool has_segments = false, has_input = false, has_offset = false;
+    while (getline(in, line)) {
+        auto space = line.find(' ');
+        if (space == string::npos) continue;
+        auto key = line.substr(0, space);
+        StringView value(line.data() + space + 1, line.size() - space - 1);
+        if (key == "segments") {
+            has_segments = Utils::StringViewTo(value, state.segments);
+        } else if (key == "input") {
+            has_input = Utils::StringViewTo(value, state.input);
+        } else if (key == "offset") {
+            has_offset = Utils::StringViewTo(value, state.offset);
+        } else if (key == "input_file") {
+            state.inputs.push_back(value.to_string());
+        } else if (key == "output_file") {
+            state.outputs.push_back(value.to_string());
+        } else if (key == "settings") {
+            state.settings = value.to_string();
+        }
+    }
+    return has_segments && has_input && has_offset;
+}
+
+void WriteCheckpoint(const string& file, const CheckpointState& state) {
+    auto tmp = file + ".tmp";
+    {
+        ofstream out(tmp, ios::trunc);
+        out << kCheckpointHeader << '\n'
+            << "segments " << state.segments << '\n'
+            << "input " << state.input << '\n'
+            << "offset " << state.offset << '\n';
+        for (const auto& f : state.inputs) {
+            out << "input_file " << f << '\n';
+        }
+        for (const auto& f : state.outputs) {
+            out << "output_file " << f << '\n';
+        }
+        out << "settings " << state.settings << '\n';
+        if (!out.flush()) Utils::Error("failed to write the checkpoint " + tmp);
+    }
+    SyncFile(tmp);
+    if (rename(tmp.c_str(), file.c_str()) != 0) {
+        Utils::Error("failed to write the checkpoint " + file);
+    }
+}
+
+CheckpointedOutputs::CheckpointedOutputs(const string& checkpoint_file
+                                         , const CheckpointState& state
+                                         , chrono::seconds interval
+                                         , bool with_index
+                                         , OpenFunction open)
+    : checkpoint_file_(checkpoint_file)
+      , state_(state)
+      , interval_(interval)
+      , last_checkpoint_(chrono::steady_clock::now())
+      , with_index_(with_index)
+      , open_(move(open))
+      , writers_(state.outputs.size())
+      , indices_(state.outputs.size()) {
+    // segments written after the checkpoint are incomplete, the run writes them again
+    for (const auto& output : state_.outputs) {
+        for (auto segment = state_.segments; FileExists(SegmentFile(output, segment)); ++segment) {
+            remove(SegmentFile(output, segment).c_str());
+            remove((SegmentFile(output, segment) + ".pbi").c_str());
+        }
+    }
+    _open_segments();
+}
+
+string CheckpointedOutputs::SegmentFile(const string& output, size_t segment) {
+    return output + ".seg" + to_string(segment);
+}
+
+void CheckpointedOutputs::Bind(vector<PipelineInput>& inputs, const vector<size_t>& output_of_input) {
+    output_of_input_ = output_of_input;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        auto out = output_of_input_[state_.input + i];
+        inputs[i].writer = writers_[out].get();
+        inputs[i].index = indices_[out].get();
+    }
+}
+
+void CheckpointedOutputs::AfterWrite(vector<PipelineInput>& inputs, size_t input, int64_t input_offset) {
+    auto now = chrono::steady_clock::now();
+    if (now - last_checkpoint_ < interval_) return;
+    last_checkpoint_ = now;
+    _close_segments();
+    auto next = state_;
+    ++next.segments;
+    next.input = state_.input + input;
+    next.offset = input_offset;
+    WriteCheckpoint(checkpoint_file_, next);
+    // the pipeline keeps counting its inputs from where this run started
+    auto first_input = state_.input;
+    state_.segments = next.segments;
+    _open_segments();
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        auto out = output_of_input_[first_input + i];
+        inputs[i].writer = writers_[out].get();
+        inputs[i].index = indices_[out].get();
+    }
+    Utils::Info("checkpoint " + to_string(next.segments) + " written to " + checkpoint_file_);
+}
+
+void CheckpointedOutputs::Finish() {
+    _close_segments();
+    auto segments = state_.segments + 1;
+    for (const auto& output : state_.outputs) {
+        if (segments == 1) {
+            auto segment = SegmentFile(output, 0);
+            if (rename(segment.c_str(), output.c_str()) != 0
+                || (with_index_ && rename((segment + ".pbi").c_str(), (output + ".pbi").c_str()) != 0)) {
+                Utils::Error("failed to move " + segment + " into place as " + output);
+            }
+            continue;
+        }
+        vector<string> files;
+        for (size_t segment = 0; segment < segments; ++segment) {
+            files.push_back(SegmentFile(output, segment));
+        }
+        MergeBams(files, output, with_index_);
+        for (const auto& f : files) {
+            remove(f.c_str());
+            remove((f + ".pbi").c_str());
+        }
+    }
+    remove(checkpoint_file_.c_str());
+}
+
+void CheckpointedOutputs::_open_segments() {
+    for (size_t out = 0; out < state_.outputs.size(); ++out) {
+        open_(SegmentFile(state_.outputs[out], state_.segments), out, writers_[out], indices_[out]);
+    }
+}
+
+void CheckpointedOutputs::_close_segments() {
+    for (size_t out = 0; out < state_.outputs.size(); ++out) {
+        if (indices_[out]) {
+            indices_[out]->Close();
+            indices_[out].reset();
+        }
+        writers_[out].reset();
+        auto file = SegmentFile(state_.outputs[out], state_.segments);
+        SyncFile(file);
+        if (with_index_) SyncFile(file + ".pbi");
+    }
+}
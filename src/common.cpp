@@ -1,4 +1,5 @@
 #include "common.hpp"
+#include <cstdio>
 #include <vector>
 #include <iostream>
 
@@ -28,26 +29,72 @@ std::vector<StringView> Tokenize(StringView line, char delimiter) {
 }
 
 
-template < >
-bool StringViewTo(const StringView& s, int& ret) {
+size_t FormatInt(int64_t v, char *out) {
+    char digits[20];
+    size_t n = 0;
+    // work on the negative side so that INT64_MIN does not overflow
+    int64_t neg = v < 0 ? v : -v;
+    do {
+        digits[n++] = static_cast<char>('0' - neg % 10);
+        neg /= 10;
+    } while (neg);
+    size_t len = 0;
+    if (v < 0) out[len++] = '-';
+    while (n) out[len++] = digits[--n];
+    return len;
+}
+
+bool ParseByteSize(const StringView& s, uint64_t& bytes) {
     if (s.empty()) return false;
-    auto iter = s.cbegin();
-    bool negative = false;
-    if (*iter == '-') {
-        negative = true;
-        ++iter;
-        if (iter == s.cend()) return false;
-    }
-    ret = 0;
-    for (; iter != s.cend(); ++iter) {
-        if (*iter < '0' || *iter > '9') return false;
-        ret *= 10;
-        ret += *iter - '0';
+    int shift = 0;
+    switch (s.back()) {
+        case 'k':
+        case 'K':
+            shift = 10;
+            break;
+        case 'm':
+        case 'M':
+            shift = 20;
+            break;
+        case 'g':
+        case 'G':
+            shift = 30;
+            break;
+        case 't':
+        case 'T':
+            shift = 40;
+            break;
+        default:
+            break;
     }
-    if (negative) ret = -ret;
+    uint64_t n;
+    if (!StringViewTo(shift ? s.substr(0, s.size() - 1) : s, n)) return false;
+    if (shift && n > (UINT64_MAX >> shift)) return false;
+    bytes = n << shift;
     return true;
 }
 
+std::string FormatByteSize(uint64_t bytes) {
+    static const char units[] = "BKMGT";
+    double v = static_cast<double>(bytes);
+    int unit = 0;
+    while (v >= 1024 && unit < 4) {
+        v /= 1024;
+        ++unit;
+    }
+    char buffer[32];
+    if (unit == 0) {
+        snprintf(buffer, sizeof(buffer), "%luB", static_cast<unsigned long>(bytes));
+    } else {
+        snprintf(buffer, sizeof(buffer), "%.1f%c", v, units[unit]);
+    }
+    return buffer;
+}
+
+void Info(const std::string& s) {
+    std::cerr << KERNAL_CYAN "[Info] " + s + KERNAL_RESET "\n";
+}
+
 void Warning(const std::string& s) {
     std::cerr << KERNAL_BOLDMAGENTA << "[Warning] " << s << KERNAL_RESET << std::endl;
 }
@@ -0,0 +1,105 @@
+#include "fastx.hpp"
+
+using namespace std;
+
+constexpr size_t FastxWriter::kBufferSize;
+
+namespace {
+
+bool EndsWith(StringView s, StringView suffix) {
+    return s.size() >= suffix.size() && s.substr(s.size() - suffix.size()) == suffix;
+}
+
+}
+
+bool ParseOutputFormat(StringView s, OutputFormat& format) {
+    if (s == "bam") {
+        format = OutputFormat::BAM;
+    } else if (s == "fasta") {
+        format = OutputFormat::FASTA;
+    } else if (s == "fastq") {
+        format = OutputFormat::FASTQ;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *OutputFormatName(OutputFormat format) {
+    switch (format) {
+        case OutputFormat::FASTA:
+            return "fasta";
+        case OutputFormat::FASTQ:
+            return "fastq";
+        default:
+            return "bam";
+    }
+}
+
+OutputFormat OutputFormatOfFile(const string& file) {
+    StringView name(file);
+    if (EndsWith(name, ".gz")) {
+        name = name.substr(0, name.size() - 3);
+    }
+    if (EndsWith(name, ".fa") || EndsWith(name, ".fasta")) return OutputFormat::FASTA;
+    if (EndsWith(name, ".fq") || EndsWith(name, ".fastq")) return OutputFormat::FASTQ;
+    return OutputFormat::BAM;
+}
+
+bool IsGzipped(const string& file) {
+    return EndsWith(StringView(file), ".gz");
+}
+
+void AppendFastx(string& out, OutputFormat format, StringView name, StringView sequence, StringView qualities) {
+    out += format == OutputFormat::FASTQ ? '@' : '>';
+    out.append(name.data(), name.size());
+    out += '\n';
+    out.append(sequence.data(), sequence.size());
+    out += '\n';
+    if (format == OutputFormat::FASTQ) {
+        out += "+\n";
+        out.append(qualities.data(), qualities.size());
+        out += '\n';
+    }
+}
+
+FastxWriter::FastxWriter(const string& file, bool gzipped, int level, size_t compression_threads)
+    : file_(file)
+      , bgzf_(nullptr)
+      , plain_(nullptr) {
+    if (gzipped) {
+        char mode[] = "w0";
+        mode[1] = static_cast<char>('0' + level);
+        bgzf_ = bgzf_open(file.c_str(), mode);
+        if (bgzf_ == nullptr) {
+            Utils::Error("failed to open " + file + " for writing");
+        }
+        if (compression_threads > 1 && bgzf_mt(bgzf_, static_cast<int>(compression_threads), 256) != 0) {
+            Utils::Warning("failed to start " + to_string(compression_threads) + " compression threads for " + file);
+        }
+        return;
+    }
+    plain_ = file == "-" ? stdout : fopen(file.c_str(), "wb");
+    if (plain_ == nullptr) {
+        Utils::Error("failed to open " + file + " for writing");
+    }
+    setvbuf(plain_, nullptr, _IOFBF, kBufferSize);
+}
+
+FastxWriter::~FastxWriter() {
+    if (bgzf_ && bgzf_close(bgzf_) != 0) {
+        Utils::Error("failed to finish " + file_);
+    }
+    if (plain_ && (plain_ == stdout ? fflush(plain_) : fclose(plain_)) != 0) {
+        Utils::Error("failed to finish " + file_);
+    }
+}
+
+void FastxWriter::Write(StringView text) {
+    if (text.empty()) return;
+    bool failed = bgzf_ ? bgzf_write(bgzf_, text.data(), text.size()) < 0
+                        : fwrite(text.data(), 1, text.size(), plain_) != text.size();
+    if (failed) {
+        Utils::Error("failed to write to " + file_);
+    }
+}
@@ -1,21 +1,32 @@
 #include <stdlib.h>
+#include <getopt.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <array>
-#include <thread>
 
 #include <boost/filesystem.hpp>
 
 #include <pbbam/BamReader.h>
 #include <pbbam/BamRecord.h>
 #include <pbbam/BamWriter.h>
-
-#include "Ssw.h"
+#include <pbbam/DataSet.h>
+#include <pbbam/PbiBuilder.h>
+#include <pbbam/PbiIndexedBamReader.h>
+#include <pbbam/PbiRawData.h>
 
 #include "common.hpp"
 #include "version.inc"
-#include "threads.hpp"
+#include "async_writer.hpp"
+#include "checkpoint.hpp"
+#include "merge.hpp"
+#include "pipeline.hpp"
+#include "shard.hpp"
+#include "topology.hpp"
 
 using namespace std;
 using namespace PacBio::BAM;
@@ -33,290 +44,584 @@ enum Arguments {
     , SW_GAP_OPEN_PENALTY
     , SW_GAP_EXT_PENALTY
     , MIN_LENGTH_REPORT
+    , VERBOSE
+    , COMPRESSION_THREADS
+    , MAX_MEMORY
+    , NUMA
+    , NUMA_BENCHMARK
+    , NO_PBI
+    , SHARD
+    , ZMW_RANGE
+    , COMPRESSION_LEVEL
+    , CHECKPOINT
+    , RESUME
+    , NO_ADAPTER_OUTPUT
+    , AMBIGUOUS_OUTPUT
+    , KEEP_UNSPLIT
+    , FORMAT
+    , CCS
+    , BY_ZMW
+    , MIN_RQ
+    , SIDECAR
+    , FROM_SIDECAR
+    , SWEEP
+    , SWEEP_REPORT
+    , STATS_ONLY
+    , SAMPLE_FRACTION
+    , SAMPLE_ZMWS
+    , SAMPLE_SEED
     , SIZE
 };
 
+// long options without a short form are told apart from the short ones by values past any char
+enum LongOption {
+    LONG_MAX_MEMORY = 256
+    , LONG_NUMA
+    , LONG_NUMA_BENCHMARK
+    , LONG_NO_PBI
+    , LONG_SHARD
+    , LONG_ZMW_RANGE
+    , LONG_CHECKPOINT
+    , LONG_RESUME
+    , LONG_NO_ADAPTER_OUTPUT
+    , LONG_AMBIGUOUS_OUTPUT
+    , LONG_KEEP_UNSPLIT
+    , LONG_FORMAT
+    , LONG_CCS
+    , LONG_BY_ZMW
+    , LONG_MIN_RQ
+    , LONG_SIDECAR
+    , LONG_FROM_SIDECAR
+    , LONG_SWEEP
+    , LONG_SWEEP_REPORT
+    , LONG_STATS_ONLY
+    , LONG_SAMPLE_FRACTION
+    , LONG_SAMPLE_ZMWS
+    , LONG_SAMPLE_SEED
+};
+
 using argument_type = array<string, Arguments::SIZE>;
 
-template <bool is_left>
-void SplitBam(const BamRecord& record
-              , BamRecord& outbam
-              , const StringView& run_name
-              , const StringView& zmw
-              , int left_start
-              , int right_end
-              , const StripedSmithWaterman::Alignment& alignment
-             ) {
-    // name
-    stringstream name;
-    name << run_name.to_string() << '/' << zmw << '/';
-    if (is_left) {
-        name << left_start << '_' << (left_start + alignment.ref_begin);
-    } else {
-        name << (left_start + alignment.ref_end + 1) << '_' << right_end;
-    }
-    outbam.Impl().Name(name.str());
-    // sequence
-    outbam.Impl().SetSequenceAndQualities(
-        is_left ?
-        record.Sequence().substr(0, alignment.ref_begin) :
-        record.Sequence().substr(alignment.ref_end + 1)
-        , ""
-    );
-    // tags
-    const auto& original_tags = record.Impl().Tags();
-    TagCollection newtags;
-    // direct copy tags
-    for (auto t  : {"np", "rq", "sn", "zm", "RG"}) {
-        newtags[t] = original_tags.at(t);
-    }
-    // special tag
-    newtags["qs"] = (is_left ? left_start : left_start + alignment.ref_end + 1);
-    newtags["qe"] = (is_left ? left_start + alignment.ref_begin : right_end);
-    newtags["cx"] = original_tags.at("cx").ToUInt8()
-        | (is_left ? PacBio::BAM::LocalContextFlags::ADAPTER_BEFORE : PacBio::BAM::LocalContextFlags::ADAPTER_AFTER);
-    // TODO: this can be more efficient
-    auto ipd = record.IPD().Encode();
-    if (is_left) {
-        newtags["ip"] = decltype(ipd){ipd.cbegin(), ipd.cbegin() + alignment.ref_begin};
-    } else {
-        newtags["ip"] = decltype(ipd){ipd.cbegin() + alignment.ref_end + 1, ipd.cend()};
-    }
+// "-" reads from stdin or writes to stdout
+bool IsStdStream(const string& file) { return file == "-"; }
 
-    auto pw = record.PulseWidth().Encode();
-    if (is_left) {
-        newtags["pw"] = decltype(pw){pw.cbegin(), pw.cbegin() + alignment.ref_begin};
-    } else {
-        newtags["pw"] = decltype(pw){pw.cbegin() + alignment.ref_end + 1, pw.cend()};
-    }
-    outbam.Impl().Tags(newtags);
+bool Sampling(const argument_type& args) {
+    return !args[Arguments::SAMPLE_FRACTION].empty() || !args[Arguments::SAMPLE_ZMWS].empty();
 }
 
+// the whole input, or only the ZMWs of --shard, --zmws or a sample found through the input's .pbi;
+// a sample adds its size to @sample
+unique_ptr<BamReader> OpenInput(const argument_type& args, const string& subread_bam_file, ZmwSample& sample) {
+    if (args[Arguments::SHARD].empty() && args[Arguments::ZMW_RANGE].empty() && !Sampling(args)) {
+        return unique_ptr<BamReader>(new BamReader(subread_bam_file));
+    }
+    auto pbi_file = subread_bam_file + ".pbi";
+    if (access(pbi_file.c_str(), F_OK) == -1) {
+        Utils::Error("--shard, --zmws and sampling need the index " + pbi_file + ", run pbindex on the input first");
+    }
+    if (Sampling(args)) {
+        double fraction = 0;
+        size_t num_zmws = 0;
+        uint64_t seed = 0;
+        Utils::StringViewTo(StringView(args[Arguments::SAMPLE_FRACTION]), fraction);
+        Utils::StringViewTo(StringView(args[Arguments::SAMPLE_ZMWS]), num_zmws);
+        Utils::StringViewTo(StringView(args[Arguments::SAMPLE_SEED]), seed);
+        auto zmws = Shard::SampleZmws(PbiRawData(pbi_file), fraction, num_zmws, seed, sample);
+        return unique_ptr<BamReader>(new PbiIndexedBamReader(Shard::ZmwFilter(zmws), subread_bam_file));
+    }
+    ZmwRange range;
+    if (!args[Arguments::SHARD].empty()) {
+        size_t shard, num_shards;
+        if (!Shard::ParseShard(args[Arguments::SHARD], shard, num_shards)) {
+            Utils::Error("--shard expects i/N with 0 <= i < N, got " + args[Arguments::SHARD]);
+        }
+        PbiRawData index(pbi_file);
+        if (!Shard::SortedByZmw(index)) {
+            Utils::Error("--shard needs " + subread_bam_file + " to be sorted by ZMW");
+        }
+        range = Shard::ShardRange(index, shard, num_shards);
+    } else if (!Shard::ParseZmwRange(args[Arguments::ZMW_RANGE], range)) {
+        Utils::Error("--zmws expects first-last, got " + args[Arguments::ZMW_RANGE]);
+    }
+    return unique_ptr<BamReader>(new PbiIndexedBamReader(Shard::RangeFilter(range), subread_bam_file));
+}
 
-std::mutex k_io_mx;
-
-class BamSplitter {
-private:
-    using queue_type = MultiThreadSafeQueue<vector, BamRecord>;
-
-    uint16_t min_sw_score_;
-    uint16_t min_sw_diff_;
-    uint8_t match_score_;
-    uint8_t mismatch_penalty_;
-    uint8_t gap_open_penalty_;
-    uint8_t gap_ext_penalty_;
-    int min_len_;
-    queue_type& queue_;
-    BamWriter& writer_;
-    const BamHeader& header_;
-    const string& primer_seq_;
-
-public:
-    BamSplitter(queue_type& q
-                , BamWriter& w
-                , const string& p
-                , const BamHeader& h
-                , uint16_t min_sw_score
-                , uint16_t min_sw_diff
-                , uint8_t match_score
-                , uint8_t mismatch_penalty
-                , uint8_t gap_open_penalty
-                , uint8_t gap_ext_penalty
-                , int minlen
-               )
-        : queue_(q)
-          , writer_(w)
-          , primer_seq_(p)
-          , header_(h)
-          , min_sw_score_(min_sw_score)
-          , min_sw_diff_(min_sw_diff)
-          , match_score_(match_score)
-          , mismatch_penalty_(mismatch_penalty)
-          , gap_open_penalty_(gap_open_penalty)
-          , gap_ext_penalty_(gap_ext_penalty)
-          , min_len_{minlen} {}
-
-    BamSplitter(const BamSplitter&) = delete;
-
-    BamSplitter(BamSplitter&& other) noexcept
-        :
-        queue_(other.queue_)
-        , writer_(other.writer_)
-        , header_(other.header_)
-        , primer_seq_(other.primer_seq_)
-        , min_sw_score_(other.min_sw_score_)
-        , min_sw_diff_(other.min_sw_diff_)
-        , match_score_(other.match_score_)
-        , mismatch_penalty_(other.mismatch_penalty_)
-        , gap_open_penalty_(other.gap_open_penalty_)
-        , gap_ext_penalty_(other.gap_ext_penalty_)
-        , min_len_(other.min_len_) {}
-
-    BamSplitter& operator=(const BamSplitter&) = delete;
-
-    void _prepare_scoring_matrix(int8_t *scoring_matrix) {
-        int i = 0;
-        scoring_matrix[i++] = match_score_;       /* A-A */
-        scoring_matrix[i++] = -mismatch_penalty_; /* A-C */
-        scoring_matrix[i++] = -mismatch_penalty_; /* A-G */
-        scoring_matrix[i++] = -mismatch_penalty_; /* A-T */
-        scoring_matrix[i++] = match_score_ >> 1; /* A-N */
+// every read group of every input says CCS
+bool IsCcs(const vector<unique_ptr<BamReader>>& readers) {
+    for (const auto& reader : readers) {
+        auto read_groups = reader->Header().ReadGroups();
+        if (read_groups.empty()) return false;
+        for (const auto& rg : read_groups) {
+            if (rg.ReadType() != "CCS") return false;
+        }
+    }
+    return true;
+}
 
-        scoring_matrix[i++] = -mismatch_penalty_; /* C-A */
-        scoring_matrix[i++] = match_score_;       /* C-C */
-        scoring_matrix[i++] = -mismatch_penalty_; /* C-G */
-        scoring_matrix[i++] = -mismatch_penalty_; /* C-T */
-        scoring_matrix[i++] = match_score_ >> 1; /* C-N */
+// the summary of --stats-only
+void WriteStatsJson(const string& file
+                    , const argument_type& args
+                    , const vector<string>& inputs
+                    , const Pipeline& pipeline
+                    , const ZmwSample& sample) {
+    ofstream out_file;
+    if (!IsStdStream(file)) {
+        out_file.open(file);
+        if (!out_file.is_open()) {
+            Utils::Error("failed to open " + file + " for writing");
+        }
+    }
+    ostream& out = IsStdStream(file) ? cout : out_file;
+    const auto& stats = pipeline.Stats();
+    out << "{\n  \"inputs\": [";
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        out << (i ? ", " : "");
+        WriteJsonString(out, inputs[i]);
+    }
+    out << "],\n  \"primer\": ";
+    WriteJsonString(out, args[Arguments::PRIMER]);
+    out << ",\n  \"min_sw_score\": " << args[Arguments::MIN_SW_SCORE]
+        << ",\n  \"min_sw_diff\": " << args[Arguments::MIN_SW_SCORE_DIFF]
+        << ",\n  \"reads\": " << pipeline.RecordsIn()
+        << ",\n  \"bases\": " << pipeline.BasesIn()
+        << ",\n  \"triaged\": {\"length\": " << pipeline.Triaged(TRIAGE_LENGTH)
+        << ", \"rq\": " << pipeline.Triaged(TRIAGE_RQ)
+        << ", \"composition\": " << pipeline.Triaged(TRIAGE_COMPOSITION) << "}"
+        << ",\n  \"aligned\": " << stats.aligned
+        << ",\n  \"hits\": " << stats.hits
+        << ",\n  \"no_adapter\": " << stats.no_adapter
+        << ",\n  \"ambiguous\": " << stats.ambiguous
+        << ",\n  \"hit_rate\": " << (pipeline.RecordsIn() ? double(stats.hits) / pipeline.RecordsIn() : 0.0)
+        << ",\n  \"sw_score_histogram\": ";
+    WriteJsonArray(out, stats.sw_score);
+    out << ",\n  \"sw_score_diff_histogram\": ";
+    WriteJsonArray(out, stats.sw_score_diff);
+    out << ",\n  \"hit_relative_position\": {\"bin_width\": " << 1.0 / AdapterStats::kRelativeBins
+        << ", \"counts\": ";
+    WriteJsonArray(out, stats.relative_position);
+    out << "},\n  \"hit_offset\": {\"bin_width\": " << AdapterStats::kOffsetBinWidth << ", \"counts\": ";
+    WriteJsonArray(out, stats.offset);
+    out << "}";
+    if (Sampling(args)) {
+        // the counts above are of the sample, the histograms keep their shape in the whole input
+        double scale = sample.sampled_records ? double(sample.records) / sample.sampled_records : 0.0;
+        out << ",\n  \"sample\": {\"seed\": " << args[Arguments::SAMPLE_SEED]
+            << ", \"zmws\": " << sample.zmws << ", \"sampled_zmws\": " << sample.sampled_zmws
+            << ", \"reads\": " << sample.records << ", \"sampled_reads\": " << sample.sampled_records
+            << ", \"scale\": " << scale << "}"
+            << ",\n  \"extrapolated\": {\"reads\": " << sample.records
+            << ", \"bases\": " << llround(pipeline.BasesIn() * scale)
+            << ", \"aligned\": " << llround(stats.aligned * scale)
+            << ", \"hits\": " << llround(stats.hits * scale)
+            << ", \"no_adapter\": " << llround(stats.no_adapter * scale)
+            << ", \"ambiguous\": " << llround(stats.ambiguous * scale) << "}";
+    }
+    out << "\n}\n";
+    out.flush();
+    if (!out) {
+        Utils::Error("failed to write the statistics to " + file);
+    }
+}
 
-        scoring_matrix[i++] = -mismatch_penalty_; /* G-A */
-        scoring_matrix[i++] = -mismatch_penalty_; /* G-C */
-        scoring_matrix[i++] = match_score_;       /* G-G */
-        scoring_matrix[i++] = -mismatch_penalty_; /* G-T */
-        scoring_matrix[i++] = match_score_ >> 1; /* G-N */
+// the options a resumed run has to share with the one that wrote the checkpoint
+string OutputSettings(const argument_type& args) {
+    string settings;
+    for (auto a : {Arguments::PRIMER, Arguments::MIN_LENGTH_REPORT, Arguments::MIN_SW_SCORE
+                   , Arguments::MIN_SW_SCORE_DIFF, Arguments::SW_MATCH_SCORE, Arguments::SW_MISMATCH_PENALTY
+                   , Arguments::SW_GAP_OPEN_PENALTY, Arguments::SW_GAP_EXT_PENALTY, Arguments::COMPRESSION_LEVEL
+                   , Arguments::NO_PBI, Arguments::KEEP_UNSPLIT, Arguments::CCS
+                   , Arguments::BY_ZMW, Arguments::MIN_RQ}) {
+        settings += args[a] + ' ';
+    }
+    return settings;
+}
 
-        scoring_matrix[i++] = -mismatch_penalty_; /* T-A */
-        scoring_matrix[i++] = -mismatch_penalty_; /* T-C */
-        scoring_matrix[i++] = -mismatch_penalty_; /* T-G */
-        scoring_matrix[i++] = match_score_;       /* T-T */
-        scoring_matrix[i++] = match_score_ >> 1; /* T-N */
+void OpenOutput(const argument_type& args
+                , const string& out_file_name
+                , const BamHeader& header
+                , unique_ptr<BamWriter>& writer
+                , unique_ptr<PbiBuilder>& index) {
+    // level 0 still frames the records in BGZF blocks, only without deflating them
+    auto level = static_cast<BamWriter::CompressionLevel>(stoi(args[Arguments::COMPRESSION_LEVEL]));
+    writer.reset(new BamWriter(out_file_name
+                               , header
+                               , level
+                               , stoul(args[Arguments::COMPRESSION_THREADS])
+                               , BamWriter::BinCalculation_OFF
+                               // stdout cannot be renamed into place
+                               , !IsStdStream(out_file_name)
+    ));
+    // built alongside the output, saves running pbindex over it afterwards
+    if (args[Arguments::NO_PBI].empty() && !IsStdStream(out_file_name)) {
+        index.reset(new PbiBuilder(out_file_name + ".pbi"
+                                   , PbiBuilder::CompressionLevel::CompressionLevel_4
+                                   , stoul(args[Arguments::COMPRESSION_THREADS])));
+    }
+}
 
-        scoring_matrix[i++] = match_score_ >> 1;     /* N-A */
-        scoring_matrix[i++] = match_score_ >> 1;     /* N-C */
-        scoring_matrix[i++] = match_score_ >> 1;     /* N-G */
-        scoring_matrix[i++] = match_score_ >> 1;     /* N-T */
-        scoring_matrix[i] = -mismatch_penalty_;   /* N-N */
+// one pass over all inputs; returns the wall time in seconds
+double Split(const argument_type& args
+             , const vector<string>& inputs
+             , const vector<string>& outputs // one per input, or a single merged one
+             , const SplitterOptions& splitter_options
+             , const PipelineOptions& pipeline_options) {
+    auto start = chrono::steady_clock::now();
+    vector<unique_ptr<BamReader>> readers;
+    ZmwSample sample = {0, 0, 0, 0};
+    for (const auto& input : inputs) {
+        readers.push_back(OpenInput(args, input, sample));
+    }
+    if (Sampling(args)) {
+        Utils::Info("sampled " + to_string(sample.sampled_zmws) + " of " + to_string(sample.zmws) + " ZMWs, "
+                        + to_string(sample.sampled_records) + " of " + to_string(sample.records) + " reads");
+    }
+    SplitterOptions options = splitter_options;
+    if (!options.ccs && IsCcs(readers)) {
+        Utils::Info("the inputs are CCS reads, splitting them as with --ccs");
+        options.ccs = true;
+    }
+    vector<BamHeader> headers;
+    vector<size_t> output_of_input;
+    if (outputs.size() == inputs.size()) {
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            headers.push_back(readers[i]->Header().DeepCopy());
+            output_of_input.push_back(i);
+        }
+    } else {
+        // pbbam refuses to merge headers whose read groups conflict
+        headers.push_back(readers.front()->Header().DeepCopy());
+        for (size_t i = 1; i < readers.size(); ++i) {
+            headers.front() += readers[i]->Header();
+        }
+        output_of_input.assign(inputs.size(), 0);
     }
 
-    void operator()() {
-        vector<BamRecord> outputs;
-        outputs.reserve(queue_.Capacity());
-        string fullname;
-        int left_start, right_end;
-        int8_t scoring_matrix[25];
-        _prepare_scoring_matrix(scoring_matrix);
-        StripedSmithWaterman::Aligner aligner{};
-        aligner.Clear();
-        aligner.RebuildScoreMatrix(scoring_matrix, 5);
-        aligner.SetGapPenalty(static_cast<uint8_t>(gap_open_penalty_)
-                              , static_cast<uint8_t>(gap_ext_penalty_));
-        StripedSmithWaterman::Filter filter;
-        StripedSmithWaterman::Alignment alignment;
-        // begin process data
-        auto data = queue_.FillAndPop();
-        while (!data.empty()) {
-            for (auto& record : data) {
-                alignment.Clear();
-                aligner.SetReferenceSequence(record.Sequence().c_str()
-                                             , record.Sequence().size());
-                aligner.Align(primer_seq_.c_str()
-                              , filter
-                              , &alignment
-                );
-                // filter
-                if (alignment.sw_score < min_sw_score_
-                    || alignment.sw_score - alignment.sw_score_next_best < min_sw_diff_) {
-                    #ifndef NDEBUG
-                    if (alignment.sw_score < min_sw_score_) {
-                        fprintf(stderr
-                                , "[1]\t%d\t%d\t%s\n"
-                                , alignment.sw_score
-                                , alignment.sw_score_next_best
-                                , record.Sequence().c_str());
-                    } else {
-                        fprintf(stderr
-                                , "[2]\t%d\t%d\t%s\n"
-                                , alignment.sw_score
-                                , alignment.sw_score_next_best
-                                , record.Sequence().c_str());
-                    }
-                    #endif
-                    continue;
-                }
-                // fix name
-                fullname = record.FullName();
-                auto tokens = Utils::Tokenize(fullname, '/');
-                auto tokens2 = Utils::Tokenize(tokens[2], '_');
-                if (!Utils::StringViewTo(tokens2[0], left_start) || !Utils::StringViewTo(tokens2[1], right_end)) {
-                    Utils::Error("failed to convert start or end");
-                }
-                // fix sequence
-                if (alignment.ref_begin > min_len_) {
-                    BamRecord l(header_);
-                    SplitBam<true>(record, l, tokens[0], tokens[1], left_start, right_end, alignment);
-                    outputs.push_back(std::move(l));
-                }
-                if (left_start + alignment.ref_end + 1 + min_len_ < right_end) {
-                    BamRecord r(header_);
-                    SplitBam<false>(record, r, tokens[0], tokens[1], left_start, right_end, alignment);
-                    outputs.push_back(std::move(r));
-                }
-            } // end of processing each BamRecord from queue
-            {
-                lock_guard<mutex> lock(k_io_mx);
-                for (const auto& o : outputs) {
-                    writer_.Write(o);
-                }
+    // unsplit reads of all inputs, each category into a file of its own
+    const Arguments category_outputs[NUM_READ_CATEGORIES] = {Arguments::NO_ADAPTER_OUTPUT, Arguments::AMBIGUOUS_OUTPUT};
+    unique_ptr<AsyncBamWriter> category_writers[NUM_READ_CATEGORIES];
+    PipelineOptions run_options = pipeline_options;
+    for (size_t c = 0; c < NUM_READ_CATEGORIES; ++c) {
+        const auto& file = args[category_outputs[c]];
+        if (file.empty()) continue;
+        auto header = readers.front()->Header().DeepCopy();
+        for (size_t i = 1; i < readers.size(); ++i) {
+            header += readers[i]->Header();
+        }
+        category_writers[c].reset(new AsyncBamWriter(
+            file
+            , header
+            , static_cast<BamWriter::CompressionLevel>(stoi(args[Arguments::COMPRESSION_LEVEL]))
+            , stoul(args[Arguments::COMPRESSION_THREADS])
+            , args[Arguments::NO_PBI].empty()));
+        run_options.category_writers[c] = category_writers[c].get();
+    }
+    unique_ptr<SidecarWriter> sidecar_out;
+    unique_ptr<SidecarReader> sidecar_in;
+    // --sweep keeps the alignments as well, but only --sidecar writes them out
+    if (!args[Arguments::SIDECAR].empty()) {
+        sidecar_out.reset(new SidecarWriter(args[Arguments::SIDECAR], options));
+        run_options.sidecar_out = sidecar_out.get();
+    }
+    if (options.from_sidecar) {
+        sidecar_in.reset(new SidecarReader(args[Arguments::FROM_SIDECAR], options));
+        run_options.sidecar_in = sidecar_in.get();
+    }
+    vector<PipelineInput> pipeline_inputs;
+    vector<unique_ptr<BamWriter>> writers(outputs.size());
+    vector<unique_ptr<PbiBuilder>> indices(outputs.size());
+    vector<unique_ptr<FastxWriter>> fastx_writers(outputs.size());
+    unique_ptr<CheckpointedOutputs> checkpoints;
+    if (options.stats_only) {
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            pipeline_inputs.push_back(PipelineInput{readers[i].get(), nullptr, nullptr, nullptr, 0, 0});
+        }
+    } else if (args[Arguments::CHECKPOINT].empty()) {
+        for (size_t out = 0; out < outputs.size(); ++out) {
+            if (options.format == OutputFormat::BAM) {
+                OpenOutput(args, outputs[out], headers[out], writers[out], indices[out]);
+            } else {
+                fastx_writers[out].reset(new FastxWriter(outputs[out]
+                                                         , IsGzipped(outputs[out])
+                                                         , stoi(args[Arguments::COMPRESSION_LEVEL])
+                                                         , stoul(args[Arguments::COMPRESSION_THREADS])));
             }
-            outputs.clear();
-            data = queue_.FillAndPop();
         }
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            auto out = output_of_input[i];
+            pipeline_inputs.push_back(PipelineInput{readers[i].get()
+                                                    , writers[out].get()
+                                                    , indices[out].get()
+                                                    , fastx_writers[out].get()
+                                                    , 0
+                                                    , 0});
+        }
+    } else {
+        auto checkpoint_file = outputs.front() + ".checkpoint";
+        CheckpointState state;
+        state.segments = 0;
+        state.input = 0;
+        state.offset = 0;
+        state.inputs = inputs;
+        state.outputs = outputs;
+        state.settings = OutputSettings(args);
+        CheckpointState saved;
+        if (!args[Arguments::RESUME].empty() && ReadCheckpoint(checkpoint_file, saved)) {
+            if (saved.inputs != state.inputs || saved.outputs != state.outputs || saved.settings != state.settings) {
+                Utils::Error("the checkpoint " + checkpoint_file + " was written by a run with other inputs, outputs or "
+                                 "options, remove it to start over");
+            }
+            state = saved;
+            Utils::Info("resuming " + inputs[state.input] + " after checkpoint " + to_string(state.segments));
+            readers[state.input]->VirtualSeek(state.offset);
+        } else if (!args[Arguments::RESUME].empty()) {
+            Utils::Warning("no checkpoint " + checkpoint_file + " to resume from, starting from the beginning");
+        }
+        // inputs before the checkpoint's are already split
+        for (size_t i = state.input; i < inputs.size(); ++i) {
+            pipeline_inputs.push_back(PipelineInput{readers[i].get(), nullptr, nullptr, nullptr, 0, 0});
+        }
+        checkpoints.reset(new CheckpointedOutputs(
+            checkpoint_file
+            , state
+            , chrono::seconds(stoul(args[Arguments::CHECKPOINT]))
+            , args[Arguments::NO_PBI].empty()
+            , [&](const string& file, size_t out, unique_ptr<BamWriter>& writer, unique_ptr<PbiBuilder>& index) {
+                OpenOutput(args, file, headers[out], writer, index);
+            }));
+        checkpoints->Bind(pipeline_inputs, output_of_input);
+        auto *c = checkpoints.get();
+        run_options.after_write = [c](vector<PipelineInput>& in, size_t input, int64_t input_offset) {
+            c->AfterWrite(in, input, input_offset);
+        };
     }
-};
 
+    if (run_options.topology) {
+        // the inputs before a checkpoint's are not read again
+        auto first = inputs.size() - pipeline_inputs.size();
+        for (size_t k = 0; k < pipeline_inputs.size(); ++k) {
+            const auto& input = inputs[first + k];
+            const auto& output = outputs[output_of_input[first + k]];
+            // a pipe has no device to be close to
+            auto& in = pipeline_inputs[k];
+            in.reader_node = IsStdStream(input) ? 0 : run_options.topology->NodeOfPath(input);
+            in.writer_node = IsStdStream(output) ? 0 : run_options.topology->NodeOfPath(output);
+            Utils::Info(input + " is read on NUMA node " + to_string(in.reader_node) + ", its output "
+                            + output + " written on node " + to_string(in.writer_node));
+        }
+    }
+    Pipeline pipeline(pipeline_inputs
+                      , options
+                      , run_options);
+    pipeline.Run();
+    for (auto& index : indices) {
+        if (index) index->Close();
+    }
+    fastx_writers.clear();
+    if (checkpoints) {
+        checkpoints->Finish();
+    }
+    for (auto& writer : category_writers) {
+        writer.reset();
+    }
+    sidecar_out.reset();
+    if (options.stats_only) {
+        WriteStatsJson(args[Arguments::STATS_ONLY], args, inputs, pipeline, sample);
+        if (Sampling(args) && sample.sampled_records) {
+            char message[128];
+            snprintf(message, sizeof(message), "extrapolated to the whole input: about %.0f of %lu reads with a hit"
+                     , double(pipeline.Stats().hits) * sample.records / sample.sampled_records
+                     , static_cast<unsigned long>(sample.records));
+            Utils::Info(message);
+        }
+    }
+    if (pipeline_options.sweep) {
+        Sweep::WriteReport(args[Arguments::SWEEP_REPORT], *pipeline_options.sweep, pipeline.SweepStatistics());
+        Utils::Info("sweep of " + to_string(pipeline_options.sweep->size()) + " combinations written to "
+                        + args[Arguments::SWEEP_REPORT]);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (pipeline_options.max_memory || options.verbose) {
+        Utils::Info("peak memory in flight: " + Utils::FormatByteSize(pipeline.PeakMemory())
+                        + (pipeline_options.max_memory ? " of " + Utils::FormatByteSize(pipeline_options.max_memory)
+                                                       : string()));
+    }
+    Utils::Info("triage: " + to_string(pipeline.Triaged(TRIAGE_LENGTH)) + " reads too short to split, "
+                    + to_string(pipeline.Triaged(TRIAGE_RQ)) + " below --min-rq, "
+                    + to_string(pipeline.Triaged(TRIAGE_COMPOSITION)) + " without the bases of a hit scoring -m"
+                    + (options.by_zmw ? " (3/4 of -m with --by-zmw)" : ""));
+    if (options.by_zmw) {
+        Utils::Info("ZMW evidence: " + to_string(pipeline.WindowHits()) + " hits found in a sibling's window, "
+                        + to_string(pipeline.RescuedHits()) + " borderline hits rescued");
+    }
+    if (options.verbose) {
+        Utils::Info("peak batches in flight: " + to_string(pipeline.PeakBatchesInFlight())
+                        + " of " + to_string(pipeline.NumBatches()));
+    }
+    if (options.verbose || !args[Arguments::NUMA_BENCHMARK].empty()) {
+        char message[160];
+        snprintf(message, sizeof(message), "%s: %lu subreads in %.2f s, %.0f subreads/s, %.1f Mb/s"
+                 , pipeline_options.topology ? "NUMA pinned" : "unpinned"
+                 , static_cast<unsigned long>(pipeline.RecordsIn()), seconds
+                 , pipeline.RecordsIn() / seconds, pipeline.BasesIn() / seconds / 1e6);
+        Utils::Info(message);
+    }
+    return seconds;
+}
+
+// the arguments of a --numa-benchmark run that writes every file into @dir instead, with
+// @outputs moved there into @scratch_outputs; the names keep their extensions for the format
+argument_type ScratchArguments(const argument_type& args
+                               , const vector<string>& outputs
+                               , const boost::filesystem::path& dir
+                               , vector<string>& scratch_outputs) {
+    auto scratch = [&dir](const string& file, const string& name) {
+        return (dir / (name + "-" + boost::filesystem::path(file).filename().string())).string();
+    };
+    scratch_outputs.clear();
+    for (size_t out = 0; out < outputs.size(); ++out) {
+        scratch_outputs.push_back(scratch(outputs[out], to_string(out)));
+    }
+    argument_type scratch_args = args;
+    scratch_args[Arguments::OUTPUT] = scratch_outputs.front();
+    for (auto file : {Arguments::NO_ADAPTER_OUTPUT, Arguments::AMBIGUOUS_OUTPUT, Arguments::SIDECAR
+                      , Arguments::SWEEP_REPORT, Arguments::STATS_ONLY}) {
+        if (args[file].empty()) continue;
+        scratch_args[file] = scratch(IsStdStream(args[file]) ? "stdout" : args[file], "arg" + to_string(file));
+    }
+    // a checkpoint left by the real run is not the benchmark's to resume
+    scratch_args[Arguments::RESUME].clear();
+    return scratch_args;
+}
+
+int SplitterMT(const argument_type& args, const vector<string>& inputs, const vector<string>& outputs) {
+    SplitterOptions options;
+    options.primer_seq = args[Arguments::PRIMER];
+    options.min_len = static_cast<int>(stoi(args[Arguments::MIN_LENGTH_REPORT]));
+    options.min_sw_score = static_cast<uint16_t>(stoi(args[Arguments::MIN_SW_SCORE]));
+    options.min_sw_diff = static_cast<uint16_t>(stoi(args[Arguments::MIN_SW_SCORE_DIFF]));
+    options.match_score = static_cast<uint8_t>(stoi(args[Arguments::SW_MATCH_SCORE]));
+    options.mismatch_penalty = static_cast<uint8_t>(stoi(args[Arguments::SW_MISMATCH_PENALTY]));
+    options.gap_open_penalty = static_cast<uint8_t>(stoi(args[Arguments::SW_GAP_OPEN_PENALTY]));
+    options.gap_ext_penalty = static_cast<uint8_t>(stoi(args[Arguments::SW_GAP_EXT_PENALTY]));
+    options.verbose = !args[Arguments::VERBOSE].empty();
+    options.keep_unsplit = !args[Arguments::KEEP_UNSPLIT].empty();
+    options.ccs = !args[Arguments::CCS].empty();
+    options.by_zmw = !args[Arguments::BY_ZMW].empty();
+    options.keep_alignments = !args[Arguments::SIDECAR].empty() || !args[Arguments::SWEEP].empty();
+    options.stats_only = !args[Arguments::STATS_ONLY].empty();
+    options.from_sidecar = !args[Arguments::FROM_SIDECAR].empty();
+    if (!Utils::StringViewTo(StringView(args[Arguments::MIN_RQ]), options.min_rq)
+        || options.min_rq < 0 || options.min_rq > 1) {
+        Utils::Error("--min-rq expects a read quality from 0 to 1, got " + args[Arguments::MIN_RQ]);
+    }
+    ParseOutputFormat(args[Arguments::FORMAT], options.format);
+    options.keep_category[ReadCategory::NO_ADAPTER] = !args[Arguments::NO_ADAPTER_OUTPUT].empty();
+    options.keep_category[ReadCategory::AMBIGUOUS] = !args[Arguments::AMBIGUOUS_OUTPUT].empty();
 
-int SplitterMT(const argument_type& args) {
-    auto out_file_name = args[Arguments::OUTPUT];
-    auto primer_seq = args[Arguments::PRIMER];
-    auto min_len_allowed = static_cast<int>(stoi(args[Arguments::MIN_LENGTH_REPORT]));
-    auto min_sw_score = static_cast<uint16_t>(stoi(args[Arguments::MIN_SW_SCORE]));
-    auto max_sw_diff = static_cast<uint16_t>(stoi(args[Arguments::MIN_SW_SCORE_DIFF]));
-    auto match_score = static_cast<uint8_t>(stoi(args[Arguments::SW_MATCH_SCORE]));
-    auto mismatch_penalty = static_cast<uint8_t>(stoi(args[Arguments::SW_MISMATCH_PENALTY]));
-    auto gap_open_penalty = static_cast<uint8_t>(stoi(args[Arguments::SW_GAP_OPEN_PENALTY]));
-    auto gap_ext_penalty = static_cast<uint8_t>(stoi(args[Arguments::SW_GAP_EXT_PENALTY]));
-    auto subread_bam_file = args[Arguments::INPUT];
-    BamReader subread_bam_fh(subread_bam_file);
-    MultiThreadSafeQueue<vector, BamRecord> queue(subread_bam_fh, stoul(args[Arguments::BULKSIZE]));
-    auto header = subread_bam_fh.Header().DeepCopy();
-    BamWriter out_fh(out_file_name
-                     , header
-                     , BamWriter::CompressionLevel::CompressionLevel_4
-                     , 1
-                     , BamWriter::BinCalculation_OFF
-    );
+    PipelineOptions pipeline_options;
+    pipeline_options.num_threads = stoul(args[Arguments::THREADS]);
+    pipeline_options.adaptive_batch_size = args[Arguments::BULKSIZE] == "auto";
+    pipeline_options.batch_size = stoul(pipeline_options.adaptive_batch_size ? DEFAULT_BULK_SIZE
+                                                                             : args[Arguments::BULKSIZE]);
+    if (!Utils::ParseByteSize(args[Arguments::MAX_MEMORY], pipeline_options.max_memory)) {
+        Utils::Error("--max-memory expects a size such as 4096, 512M or 8G, got " + args[Arguments::MAX_MEMORY]);
+    }
+    pipeline_options.topology = nullptr;
+    fill(begin(pipeline_options.category_writers), end(pipeline_options.category_writers), nullptr);
+    pipeline_options.sidecar_out = nullptr;
+    pipeline_options.sidecar_in = nullptr;
+    vector<SweepPoint> sweep;
+    pipeline_options.sweep = nullptr;
+    if (!args[Arguments::SWEEP].empty()) {
+        sweep = Sweep::ReadGrid(args[Arguments::SWEEP]);
+        pipeline_options.sweep = &sweep;
+    }
 
-    int numThreads = stoi(args[Arguments::THREADS]);
-    vector<thread> threads;
-    for (int i = 0; i < numThreads; ++i) {
-        threads.emplace_back(BamSplitter{queue, out_fh, primer_seq, header, min_sw_score, max_sw_diff, match_score
-                                         , mismatch_penalty, gap_open_penalty, gap_ext_penalty, min_len_allowed});
+    bool numa = !args[Arguments::NUMA].empty();
+    bool numa_benchmark = !args[Arguments::NUMA_BENCHMARK].empty();
+    if (!numa && !numa_benchmark) {
+        Split(args, inputs, outputs, options, pipeline_options);
+        return EXIT_SUCCESS;
+    }
+    auto topology = CpuTopology::Detect();
+    Utils::Info("NUMA topology: " + topology.ToString());
+    PipelineOptions pinned = pipeline_options;
+    pinned.topology = &topology;
+    if (!numa_benchmark) {
+        Split(args, inputs, outputs, options, pinned);
+        return EXIT_SUCCESS;
     }
-    for (auto& t : threads) {
-        if (t.joinable()) {
-            t.join();
+    // the real output comes from an untimed run that also warms the page cache; the timed runs
+    // write to a scratch directory on the same device, in the order unpinned, pinned, pinned,
+    // unpinned so that neither layout gains from running later
+    Split(args, inputs, outputs, options, pinned);
+    auto parent = boost::filesystem::path(outputs.front()).parent_path();
+    auto dir = (parent.empty() ? boost::filesystem::path(".") : parent)
+               / boost::filesystem::unique_path(".numa-benchmark-%%%%-%%%%-%%%%");
+    boost::filesystem::create_directory(dir);
+    double seconds[2] = {0, 0};
+    for (bool pin : {false, true, true, false}) {
+        vector<string> scratch_outputs;
+        auto scratch_args = ScratchArguments(args, outputs, dir, scratch_outputs);
+        seconds[pin] += Split(scratch_args, inputs, scratch_outputs, options, pin ? pinned : pipeline_options);
+        for (boost::filesystem::directory_iterator file(dir), end; file != end; ++file) {
+            boost::filesystem::remove_all(file->path());
         }
     }
+    boost::filesystem::remove_all(dir);
+    char message[128];
+    snprintf(message, sizeof(message), "NUMA pinned layout: %.2fx the throughput of the unpinned one over 2 runs each"
+             , seconds[false] / seconds[true]);
+    Utils::Info(message);
     return EXIT_SUCCESS;
 }
 
-argument_type ArgumentParse(int argc, char **argv) {
+// a SubreadSet XML stands for the BAM files it lists
+void AddInput(const string& file, vector<string>& inputs) {
+    if (file.size() > 4 && file.compare(file.size() - 4, 4, ".xml") == 0) {
+        for (const auto& bam : DataSet(file).BamFiles()) {
+            inputs.push_back(bam.Filename());
+        }
+    } else {
+        inputs.push_back(file);
+    }
+}
+
+string DefaultOutput(const string& input, OutputFormat format) {
+    string prefix = boost::filesystem::basename(input);
+    return prefix.substr(0, prefix.rfind(".bam")) + ".refarm." + OutputFormatName(format);
+}
+
+argument_type ArgumentParse(int argc, char **argv, vector<string>& inputs, vector<string>& outputs) {
     string usage =
         KERNAL_GREEN
         "This program split pacBio bam files based on a custom smrtbell sequence.\n"
         "version: v"
         PROGRAM_VERSION
-        "\nusage: [options] input.bam\n\n"
+        "\nusage: [options] input.bam|subreadset.xml ... (- for stdin)\n"
+        "       merge [-o merged.bam] [--no-pbi] split1.bam split2.bam ...\n\n"
         "options:\n"
         KERNAL_RED "\n[required]\n"
         "\tinput.bam\n"
+        "\t        one or more subreads bam files or SubreadSet XMLs, split by one shared pool of threads\n"
         KERNAL_CYAN
         "\n[optional]\n"
-        "\t-o      output bam filename, if not provided, the prefix of input bam + refarm.bam will be used\n"
+        "\t-o      output bam filename, - for stdout, if not provided, the prefix of input bam + refarm.bam will be used,\n"
+        "\t        or stdout when reading from stdin; give one -o per input in the same order, or a single -o\n"
+        "\t        to merge the outputs of all inputs into one file\n"
         "\t-p      primer sequence, default: " DEFAULT_PRIMER_SEQ "\n"
         "\t-t      number of threads to use, default: " DEFAULT_NUM_THREADS "\n"
+        "\t-c      number of threads compressing the output, on top of -t; more than one needs --no-pbi\n"
+        "\t        for bam output, default: " DEFAULT_COMPRESSION_THREADS "\n"
+        "\t-z      compression level of the output, 0 (none) to 9, default: " DEFAULT_COMPRESSION_LEVEL "\n"
+        "\t-u      uncompressed output, same as -z 0, for piping into another program\n"
+        "\t--format bam|fasta|fastq\n"
+        "\t        output format, by default taken from the extension of -o (.fa, .fasta, .fq, .fastq,\n"
+        "\t        each optionally .gz for bgzip compression with -c threads), otherwise bam\n"
         KERNAL_YELLOW
         "\n[advanced]\n"
         "\t-b      bulk of records sent to each thread every time, default: " DEFAULT_BULK_SIZE "\n"
+        "\t        \"auto\" sizes bulks by bases and tunes them from the measured processing time\n"
         "\t-l      minimal length to report in the output bam, default: " DEFAULT_MIN_LEN_REPORT "\n"
         "\t-m      minimal Smith-Waterman score between read and adaptor, default: " DEFAULT_MIN_SW_SCORE "\n"
         "\t-f      minimal Smith-Waterman score allowed between best and second-best alignments, default: " DEFAULT_MIN_SW_DIFF "\n"
@@ -324,21 +629,115 @@ argument_type ArgumentParse(int argc, char **argv) {
         "\t-S      Penalty for a mismatch, default: " DEFAULT_SW_MISMATCH_PENALTY "\n"
         "\t-O      Penalty for a gap opening, default: " DEFAULT_SW_GAP_OPEN_PENALTY "\n"
         "\t-E      Penalty for a gap extension, default: " DEFAULT_SW_GAP_EXT_PENALTY "\n"
+        "\t--max-memory\n"
+        "\t        bound on the estimated memory held by reads in flight, e.g. 8G; the reader waits\n"
+        "\t        when it is reached, 0 for no bound, default: " DEFAULT_MAX_MEMORY "\n"
+        "\t--shard i/N\n"
+        "\t        split only the i-th of N pieces of the input (0 <= i < N), cut between ZMWs;\n"
+        "\t        needs input.bam.pbi, the outputs of 0 .. N-1 concatenated equal the whole output\n"
+        "\t--zmws first-last\n"
+        "\t        split only the ZMWs with hole numbers from first to last, needs input.bam.pbi\n"
+        "\t--sample-fraction F\n"
+        "\t        split only a random fraction F (0 < F <= 1) of the ZMWs, read by seeking through input.bam.pbi;\n"
+        "\t        --stats-only then also extrapolates its counts to the whole input\n"
+        "\t--sample-zmws N\n"
+        "\t        as --sample-fraction, but N ZMWs\n"
+        "\t--sample-seed SEED\n"
+        "\t        the same SEED samples the same ZMWs, default: " DEFAULT_SAMPLE_SEED "\n"
+        "\t--no-pbi\n"
+        "\t        do not write the PacBio index output.bam.pbi next to the output\n"
+        "\t--sidecar FILE\n"
+        "\t        also write the alignment of every read to FILE, for --from-sidecar\n"
+        "\t--from-sidecar FILE\n"
+        "\t        take the alignments from the --sidecar FILE of an earlier run on the same input\n"
+        "\t        instead of aligning, to apply other -m, -f or -l in a single pass\n"
+        "\t--stats-only FILE\n"
+        "\t        only align, write no output but a JSON summary to FILE (- for stdout) with the hit rate,\n"
+        "\t        score histograms and where the hits are in the reads\n"
+        "\t--sweep GRID\n"
+        "\t        align every read once and report what each \"-m -f -l\" line of the file GRID would give;\n"
+        "\t        the output is still split with the -m, -f and -l of the command line\n"
+        "\t--sweep-report FILE\n"
+        "\t        where --sweep writes its table, default: output + .sweep.tsv\n"
+        "\t--min-rq RQ\n"
+        "\t        drop reads whose rq tag is below RQ, e.g. 0.99 for HiFi, default: " DEFAULT_MIN_RQ "\n"
+        "\t        they are not aligned, except for the rows of a --sidecar, and left out of every output\n"
+        "\t--by-zmw\n"
+        "\t        batch whole ZMWs and let a strong hit in one subread narrow the search in its siblings\n"
+        "\t        and rescue their borderline hits (3/4 of -m, still -f apart) at the same position;\n"
+        "\t        a hit found there is only tested for -f against the rest of that window\n"
+        "\t--ccs   the input are CCS/HiFi reads named movie/zmw/ccs, detected from the read groups otherwise;\n"
+        "\t        segments are named movie/zmw/ccs/begin_end, keep their base qualities and lose the kinetics\n"
+        "\t--keep-unsplit\n"
+        "\t        also write the reads that are not split to the output, unchanged and in input order\n"
+        "\t--no-adapter-output FILE\n"
+        "\t        write the reads without a primer hit scoring -m to FILE instead of dropping them\n"
+        "\t--ambiguous-output FILE\n"
+        "\t        write the reads whose best and second-best hits are closer than -f to FILE\n"
+        "\t--checkpoint SECONDS\n"
+        "\t        write the output in segments and checkpoint between them every SECONDS\n"
+        "\t        to output.bam.checkpoint; the segments are put together at the end\n"
+        "\t--resume\n"
+        "\t        with --checkpoint, carry on from the last checkpoint of an interrupted run\n"
+        "\t--numa  pin one group of workers per NUMA node, give every node its own batches and\n"
+        "\t        read and write from the nodes closest to the input and output devices\n"
+        "\t--numa-benchmark\n"
+        "\t        split with --numa, then time two more runs of each layout into a scratch\n"
+        "\t        directory next to the output and report the throughput of both\n"
+        "\t-v      report per-batch statistics to stderr\n"
         KERNAL_RESET;
 
     argument_type arguments;
+    static const struct option long_options[] = {
+        {"max-memory", required_argument, nullptr, LongOption::LONG_MAX_MEMORY},
+        {"numa", no_argument, nullptr, LongOption::LONG_NUMA},
+        {"numa-benchmark", no_argument, nullptr, LongOption::LONG_NUMA_BENCHMARK},
+        {"no-pbi", no_argument, nullptr, LongOption::LONG_NO_PBI},
+        {"shard", required_argument, nullptr, LongOption::LONG_SHARD},
+        {"zmws", required_argument, nullptr, LongOption::LONG_ZMW_RANGE},
+        {"checkpoint", required_argument, nullptr, LongOption::LONG_CHECKPOINT},
+        {"resume", no_argument, nullptr, LongOption::LONG_RESUME},
+        {"sidecar", required_argument, nullptr, LongOption::LONG_SIDECAR},
+        {"from-sidecar", required_argument, nullptr, LongOption::LONG_FROM_SIDECAR},
+        {"stats-only", required_argument, nullptr, LongOption::LONG_STATS_ONLY},
+        {"sample-fraction", required_argument, nullptr, LongOption::LONG_SAMPLE_FRACTION},
+        {"sample-zmws", required_argument, nullptr, LongOption::LONG_SAMPLE_ZMWS},
+        {"sample-seed", required_argument, nullptr, LongOption::LONG_SAMPLE_SEED},
+        {"sweep", required_argument, nullptr, LongOption::LONG_SWEEP},
+        {"sweep-report", required_argument, nullptr, LongOption::LONG_SWEEP_REPORT},
+        {"min-rq", required_argument, nullptr, LongOption::LONG_MIN_RQ},
+        {"by-zmw", no_argument, nullptr, LongOption::LONG_BY_ZMW},
+        {"ccs", no_argument, nullptr, LongOption::LONG_CCS},
+        {"format", required_argument, nullptr, LongOption::LONG_FORMAT},
+        {"keep-unsplit", no_argument, nullptr, LongOption::LONG_KEEP_UNSPLIT},
+        {"no-adapter-output", required_argument, nullptr, LongOption::LONG_NO_ADAPTER_OUTPUT},
+        {"ambiguous-output", required_argument, nullptr, LongOption::LONG_AMBIGUOUS_OUTPUT},
+        {"compression-level", required_argument, nullptr, 'z'},
+        {"uncompressed", no_argument, nullptr, 'u'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
     int c;
-    while ((c = getopt(argc, argv, "p:o:t:b:l:f:m:M:S:O:E:h")) != -1) {
+    while ((c = getopt_long(argc, argv, "p:o:t:c:z:ub:l:f:m:M:S:O:E:vh", long_options, nullptr)) != -1) {
         switch (c) {
             case 'p':
                 arguments[Arguments::PRIMER] = optarg;
                 break;
             case 'o':
-                arguments[Arguments::OUTPUT] = optarg;
+                outputs.push_back(optarg);
                 break;
             case 't':
                 arguments[Arguments::THREADS] = optarg;
                 break;
+            case 'c':
+                arguments[Arguments::COMPRESSION_THREADS] = optarg;
+                break;
+            case 'z':
+                arguments[Arguments::COMPRESSION_LEVEL] = optarg;
+                break;
+            case 'u':
+                arguments[Arguments::COMPRESSION_LEVEL] = "0";
+                break;
             case 'b':
                 arguments[Arguments::BULKSIZE] = optarg;
                 break;
@@ -363,6 +762,78 @@ argument_type ArgumentParse(int argc, char **argv) {
             case 'E':
                 arguments[Arguments::SW_GAP_EXT_PENALTY] = optarg;
                 break;
+            case 'v':
+                arguments[Arguments::VERBOSE] = "1";
+                break;
+            case LongOption::LONG_MAX_MEMORY:
+                arguments[Arguments::MAX_MEMORY] = optarg;
+                break;
+            case LongOption::LONG_NUMA:
+                arguments[Arguments::NUMA] = "1";
+                break;
+            case LongOption::LONG_NUMA_BENCHMARK:
+                arguments[Arguments::NUMA_BENCHMARK] = "1";
+                break;
+            case LongOption::LONG_NO_PBI:
+                arguments[Arguments::NO_PBI] = "1";
+                break;
+            case LongOption::LONG_SHARD:
+                arguments[Arguments::SHARD] = optarg;
+                break;
+            case LongOption::LONG_ZMW_RANGE:
+                arguments[Arguments::ZMW_RANGE] = optarg;
+                break;
+            case LongOption::LONG_CHECKPOINT:
+                arguments[Arguments::CHECKPOINT] = optarg;
+                break;
+            case LongOption::LONG_RESUME:
+                arguments[Arguments::RESUME] = "1";
+                break;
+            case LongOption::LONG_SIDECAR:
+                arguments[Arguments::SIDECAR] = optarg;
+                break;
+            case LongOption::LONG_FROM_SIDECAR:
+                arguments[Arguments::FROM_SIDECAR] = optarg;
+                break;
+            case LongOption::LONG_STATS_ONLY:
+                arguments[Arguments::STATS_ONLY] = optarg;
+                break;
+            case LongOption::LONG_SAMPLE_FRACTION:
+                arguments[Arguments::SAMPLE_FRACTION] = optarg;
+                break;
+            case LongOption::LONG_SAMPLE_ZMWS:
+                arguments[Arguments::SAMPLE_ZMWS] = optarg;
+                break;
+            case LongOption::LONG_SAMPLE_SEED:
+                arguments[Arguments::SAMPLE_SEED] = optarg;
+                break;
+            case LongOption::LONG_SWEEP:
+                arguments[Arguments::SWEEP] = optarg;
+                break;
+            case LongOption::LONG_SWEEP_REPORT:
+                arguments[Arguments::SWEEP_REPORT] = optarg;
+                break;
+            case LongOption::LONG_MIN_RQ:
+                arguments[Arguments::MIN_RQ] = optarg;
+                break;
+            case LongOption::LONG_BY_ZMW:
+                arguments[Arguments::BY_ZMW] = "1";
+                break;
+            case LongOption::LONG_CCS:
+                arguments[Arguments::CCS] = "1";
+                break;
+            case LongOption::LONG_FORMAT:
+                arguments[Arguments::FORMAT] = optarg;
+                break;
+            case LongOption::LONG_KEEP_UNSPLIT:
+                arguments[Arguments::KEEP_UNSPLIT] = "1";
+                break;
+            case LongOption::LONG_NO_ADAPTER_OUTPUT:
+                arguments[Arguments::NO_ADAPTER_OUTPUT] = optarg;
+                break;
+            case LongOption::LONG_AMBIGUOUS_OUTPUT:
+                arguments[Arguments::AMBIGUOUS_OUTPUT] = optarg;
+                break;
             case 'h':
             default:
                 cerr << usage;
@@ -372,20 +843,187 @@ argument_type ArgumentParse(int argc, char **argv) {
     if (optind == argc) {
         Utils::Error("Please provide input bam files");
     }
-    arguments[Arguments::INPUT] = argv[optind];
-    if (access(arguments[Arguments::INPUT].c_str(), F_OK) == -1) {
-        Utils::Error("Input file " + arguments[Arguments::INPUT] + " does not exist");
+    for (int i = optind; i < argc; ++i) {
+        AddInput(argv[i], inputs);
+    }
+    if (inputs.empty()) {
+        Utils::Error("The SubreadSet lists no bam files");
+    }
+    bool from_stdin = false;
+    for (const auto& input : inputs) {
+        if (IsStdStream(input)) {
+            from_stdin = true;
+        } else if (access(input.c_str(), F_OK) == -1) {
+            Utils::Error("Input file " + input + " does not exist");
+        }
+    }
+    if (from_stdin && inputs.size() > 1) {
+        Utils::Error("stdin can only be read as the only input");
+    }
+    if (!arguments[Arguments::SHARD].empty() && !arguments[Arguments::ZMW_RANGE].empty()) {
+        Utils::Error("--shard and --zmws cannot be combined");
+    }
+    if (from_stdin && !(arguments[Arguments::SHARD].empty() && arguments[Arguments::ZMW_RANGE].empty())) {
+        Utils::Error("--shard and --zmws need an indexed input file, not stdin");
+    }
+    if (Sampling(arguments)) {
+        double fraction;
+        size_t num_zmws;
+        if (!arguments[Arguments::SAMPLE_FRACTION].empty() && !arguments[Arguments::SAMPLE_ZMWS].empty()) {
+            Utils::Error("--sample-fraction and --sample-zmws cannot be combined");
+        }
+        if (!arguments[Arguments::SAMPLE_FRACTION].empty()
+            && (!Utils::StringViewTo(StringView(arguments[Arguments::SAMPLE_FRACTION]), fraction)
+                || !(fraction > 0 && fraction <= 1))) {
+            Utils::Error("--sample-fraction expects a fraction above 0 and up to 1, got "
+                             + arguments[Arguments::SAMPLE_FRACTION]);
+        }
+        if (!arguments[Arguments::SAMPLE_ZMWS].empty()
+            && (!Utils::StringViewTo(StringView(arguments[Arguments::SAMPLE_ZMWS]), num_zmws) || num_zmws == 0)) {
+            Utils::Error("--sample-zmws expects a positive number of ZMWs, got " + arguments[Arguments::SAMPLE_ZMWS]);
+        }
+        if (from_stdin) {
+            Utils::Error("sampling needs an indexed input file, not stdin");
+        }
+        if (!arguments[Arguments::SHARD].empty() || !arguments[Arguments::ZMW_RANGE].empty()) {
+            Utils::Error("sampling cannot be combined with --shard or --zmws");
+        }
+        // a sidecar or a checkpoint holds the reads of the whole input in order
+        if (!arguments[Arguments::FROM_SIDECAR].empty() || !arguments[Arguments::CHECKPOINT].empty()) {
+            Utils::Error("sampling cannot be combined with --from-sidecar or --checkpoint");
+        }
+    }
+    if (arguments[Arguments::SAMPLE_SEED].empty()) { arguments[Arguments::SAMPLE_SEED] = DEFAULT_SAMPLE_SEED; }
+    uint64_t seed;
+    if (!Utils::StringViewTo(StringView(arguments[Arguments::SAMPLE_SEED]), seed)) {
+        Utils::Error("--sample-seed expects a number, got " + arguments[Arguments::SAMPLE_SEED]);
+    }
+    if (from_stdin && !arguments[Arguments::NUMA_BENCHMARK].empty()) {
+        Utils::Error("--numa-benchmark reads the input five times and cannot read it from stdin");
+    }
+    OutputFormat format = OutputFormat::BAM;
+    if (!arguments[Arguments::FORMAT].empty() && !ParseOutputFormat(arguments[Arguments::FORMAT], format)) {
+        Utils::Error("--format expects bam, fasta or fastq, got " + arguments[Arguments::FORMAT]);
+    }
+    if (outputs.empty() && from_stdin) {
+        outputs.push_back("-");
+    } else if (outputs.empty()) {
+        for (const auto& input : inputs) {
+            outputs.push_back(DefaultOutput(input, format));
+        }
+        if (arguments[Arguments::STATS_ONLY].empty()) {
+            Utils::Warning(
+                "The user has not provided a output file prefix using -o option, will use the prefix of input bam"
+            );
+        }
+    } else if (outputs.size() != 1 && outputs.size() != inputs.size()) {
+        Utils::Error("Give either one -o per input or a single -o for a merged output, got "
+                         + to_string(outputs.size()) + " for " + to_string(inputs.size()) + " inputs");
+    }
+    if (arguments[Arguments::FORMAT].empty()) {
+        format = OutputFormatOfFile(outputs.front());
+        for (const auto& output : outputs) {
+            if (OutputFormatOfFile(output) != format) {
+                Utils::Error("All outputs need the same format, " + output + " is not " + OutputFormatName(format));
+            }
+        }
+        arguments[Arguments::FORMAT] = OutputFormatName(format);
+    }
+    arguments[Arguments::INPUT] = inputs.front();
+    arguments[Arguments::OUTPUT] = outputs.front();
+    if (IsStdStream(outputs.front()) && !arguments[Arguments::NUMA_BENCHMARK].empty()) {
+        Utils::Error("--numa-benchmark writes the output five times and cannot write it to stdout");
+    }
+    if (IsStdStream(arguments[Arguments::NO_ADAPTER_OUTPUT]) || IsStdStream(arguments[Arguments::AMBIGUOUS_OUTPUT])) {
+        Utils::Error("--no-adapter-output and --ambiguous-output need a file, stdout is for the split reads");
+    }
+    if (!arguments[Arguments::SIDECAR].empty() || !arguments[Arguments::FROM_SIDECAR].empty()) {
+        if (!arguments[Arguments::SIDECAR].empty() && !arguments[Arguments::FROM_SIDECAR].empty()) {
+            Utils::Error("--sidecar and --from-sidecar cannot be combined, the sidecar would only be copied");
+        }
+        if (IsStdStream(arguments[Arguments::SIDECAR]) || IsStdStream(arguments[Arguments::FROM_SIDECAR])) {
+            Utils::Error("--sidecar and --from-sidecar need a file");
+        }
+        // both need the full alignment of every read, in input order from the start
+        if (!arguments[Arguments::BY_ZMW].empty()) {
+            Utils::Error("--sidecar and --from-sidecar cannot be combined with --by-zmw");
+        }
+        if (!arguments[Arguments::CHECKPOINT].empty()) {
+            Utils::Error("--sidecar and --from-sidecar cannot be combined with --checkpoint");
+        }
+    }
+    if (!arguments[Arguments::STATS_ONLY].empty()) {
+        if (!arguments[Arguments::CHECKPOINT].empty()
+            || !arguments[Arguments::NO_ADAPTER_OUTPUT].empty() || !arguments[Arguments::AMBIGUOUS_OUTPUT].empty()) {
+            Utils::Error("--stats-only writes no reads, it cannot be combined with --checkpoint or category outputs");
+        }
+    }
+    if (!arguments[Arguments::SWEEP].empty()) {
+        // every point needs the full alignment of every read
+        if (!arguments[Arguments::BY_ZMW].empty()) {
+            Utils::Error("--sweep cannot be combined with --by-zmw");
+        }
+        if (!arguments[Arguments::CHECKPOINT].empty()) {
+            Utils::Error("--sweep cannot be combined with --checkpoint, a resumed run would only count the rest");
+        }
+        if (arguments[Arguments::SWEEP_REPORT].empty()) {
+            if (IsStdStream(outputs.front())) {
+                Utils::Error("--sweep with output to stdout needs --sweep-report");
+            }
+            arguments[Arguments::SWEEP_REPORT] = outputs.front() + ".sweep.tsv";
+        }
     }
-    if (arguments[Arguments::OUTPUT].empty()) {
-        string prefix = boost::filesystem::basename(arguments[Arguments::INPUT]);
-        arguments[Arguments::OUTPUT] = prefix.substr(0, prefix.rfind(".bam")) + ".refarm.bam";
-        Utils::Warning(
-            "The user has not provided a output file prefix using -o option, will use the prefix of input bam"
-        );
+    if (!arguments[Arguments::RESUME].empty() && arguments[Arguments::CHECKPOINT].empty()) {
+        Utils::Error("--resume needs --checkpoint");
+    }
+    if (!arguments[Arguments::CHECKPOINT].empty()) {
+        size_t interval;
+        if (!Utils::StringViewTo(StringView(arguments[Arguments::CHECKPOINT]), interval) || interval == 0) {
+            Utils::Error("--checkpoint expects a number of seconds, got " + arguments[Arguments::CHECKPOINT]);
+        }
+        // resuming seeks the input and puts the output together from files
+        if (from_stdin || IsStdStream(outputs.front())) {
+            Utils::Error("--checkpoint needs input and output files, not stdin or stdout");
+        }
+        if (!arguments[Arguments::SHARD].empty() || !arguments[Arguments::ZMW_RANGE].empty()) {
+            Utils::Error("--checkpoint cannot be combined with --shard or --zmws, shards are meant to be rerun");
+        }
+        if (!arguments[Arguments::NO_ADAPTER_OUTPUT].empty() || !arguments[Arguments::AMBIGUOUS_OUTPUT].empty()) {
+            Utils::Error("--checkpoint only covers the split output, not --no-adapter-output or --ambiguous-output");
+        }
+        if (format != OutputFormat::BAM) {
+            Utils::Error("--checkpoint needs bam output");
+        }
     }
     if (arguments[Arguments::PRIMER].empty()) { arguments[Arguments::PRIMER] = DEFAULT_PRIMER_SEQ; }
     if (arguments[Arguments::THREADS].empty()) { arguments[Arguments::THREADS] = DEFAULT_NUM_THREADS; }
+    if (arguments[Arguments::COMPRESSION_THREADS].empty()) {
+        arguments[Arguments::COMPRESSION_THREADS] = DEFAULT_COMPRESSION_THREADS;
+    }
+    if (arguments[Arguments::COMPRESSION_LEVEL].empty()) {
+        arguments[Arguments::COMPRESSION_LEVEL] = DEFAULT_COMPRESSION_LEVEL;
+    }
+    size_t compression_threads;
+    if (!Utils::StringViewTo(StringView(arguments[Arguments::COMPRESSION_THREADS]), compression_threads)) {
+        Utils::Error("-c expects a number of threads, got " + arguments[Arguments::COMPRESSION_THREADS]);
+    }
+    // with htslib's compression threads bgzf_tell() is not the final virtual offset of a record yet,
+    // and the .pbi written along would point into the wrong blocks
+    bool indexed = arguments[Arguments::NO_PBI].empty()
+        && ((format == OutputFormat::BAM && !IsStdStream(outputs.front()))
+            || !arguments[Arguments::NO_ADAPTER_OUTPUT].empty() || !arguments[Arguments::AMBIGUOUS_OUTPUT].empty());
+    if (compression_threads > 1 && indexed) {
+        Utils::Warning("the .pbi index needs a single compression thread, -c " + arguments[Arguments::COMPRESSION_THREADS]
+                           + " is ignored; add --no-pbi to compress with more and run pbindex afterwards");
+        arguments[Arguments::COMPRESSION_THREADS] = "1";
+    }
+    int level;
+    if (!Utils::StringViewTo(StringView(arguments[Arguments::COMPRESSION_LEVEL]), level) || level < 0 || level > 9) {
+        Utils::Error("-z expects a compression level from 0 to 9, got " + arguments[Arguments::COMPRESSION_LEVEL]);
+    }
     if (arguments[Arguments::BULKSIZE].empty()) { arguments[Arguments::BULKSIZE] = DEFAULT_BULK_SIZE; }
+    if (arguments[Arguments::MAX_MEMORY].empty()) { arguments[Arguments::MAX_MEMORY] = DEFAULT_MAX_MEMORY; }
+    if (arguments[Arguments::MIN_RQ].empty()) { arguments[Arguments::MIN_RQ] = DEFAULT_MIN_RQ; }
     if (arguments[Arguments::MIN_LENGTH_REPORT].empty()) {
         arguments[Arguments::MIN_LENGTH_REPORT] = DEFAULT_MIN_LEN_REPORT;
     }
@@ -403,10 +1041,85 @@ argument_type ArgumentParse(int argc, char **argv) {
     if (arguments[Arguments::SW_GAP_EXT_PENALTY].empty()) {
         arguments[Arguments::SW_GAP_EXT_PENALTY] = DEFAULT_SW_GAP_EXT_PENALTY;
     }
+    // parsed into the types SplitterOptions keeps them in, -m 70000 must not wrap around
+    int32_t min_len;
+    if (!Utils::StringViewTo(StringView(arguments[Arguments::MIN_LENGTH_REPORT]), min_len) || min_len < 0) {
+        Utils::Error("-l expects a length from 0 to " + to_string(INT32_MAX)
+                         + ", got " + arguments[Arguments::MIN_LENGTH_REPORT]);
+    }
+    const pair<Arguments, const char *> scores[] = {
+        {Arguments::MIN_SW_SCORE, "-m"}, {Arguments::MIN_SW_SCORE_DIFF, "-f"}
+    };
+    for (const auto& s : scores) {
+        uint16_t score;
+        if (!Utils::StringViewTo(StringView(arguments[s.first]), score)) {
+            Utils::Error(string(s.second) + " expects a score from 0 to 65535, got " + arguments[s.first]);
+        }
+    }
+    const pair<Arguments, const char *> penalties[] = {
+        {Arguments::SW_MATCH_SCORE, "-M"}, {Arguments::SW_MISMATCH_PENALTY, "-S"}
+        , {Arguments::SW_GAP_OPEN_PENALTY, "-O"}, {Arguments::SW_GAP_EXT_PENALTY, "-E"}
+    };
+    for (const auto& s : penalties) {
+        uint8_t penalty;
+        if (!Utils::StringViewTo(StringView(arguments[s.first]), penalty)) {
+            Utils::Error(string(s.second) + " expects a value from 0 to 255, got " + arguments[s.first]);
+        }
+    }
     return arguments;
 }
 
+int MergeMain(int argc, char **argv) {
+    string usage =
+        KERNAL_GREEN
+        "Concatenate outputs of this program, e.g. of --shard 0/N to N-1/N, without recompressing them.\n"
+        "\nusage: merge [options] split1.bam split2.bam ...\n\n"
+        "options:\n"
+        KERNAL_CYAN
+        "\t-o      merged output bam filename, default: merged.bam\n"
+        "\t--no-pbi\n"
+        "\t        do not merge the inputs' .pbi indices into merged.bam.pbi\n"
+        KERNAL_RESET;
+    static const struct option long_options[] = {
+        {"no-pbi", no_argument, nullptr, LongOption::LONG_NO_PBI},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+    string output = "merged.bam";
+    bool with_index = true;
+    int c;
+    while ((c = getopt_long(argc, argv, "o:h", long_options, nullptr)) != -1) {
+        switch (c) {
+            case 'o':
+                output = optarg;
+                break;
+            case LongOption::LONG_NO_PBI:
+                with_index = false;
+                break;
+            case 'h':
+            default:
+                cerr << usage;
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (optind == argc) {
+        Utils::Error("Please provide the bam files to merge");
+    }
+    vector<string> inputs(argv + optind, argv + argc);
+    for (const auto& input : inputs) {
+        if (access(input.c_str(), F_OK) == -1) {
+            Utils::Error("Input file " + input + " does not exist");
+        }
+    }
+    MergeBams(inputs, output, with_index);
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char **argv) {
-    auto args = ArgumentParse(argc, argv);
-    return SplitterMT(args);
+    if (argc > 1 && string(argv[1]) == "merge") {
+        return MergeMain(argc - 1, argv + 1);
+    }
+    vector<string> inputs, outputs;
+    auto args = ArgumentParse(argc, argv, inputs, outputs);
+    return SplitterMT(args, inputs, outputs);
 }
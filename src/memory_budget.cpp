@@ -0,0 +1,16 @@
+#include "memory_budget.hpp"
+
+MemoryBudget::MemoryBudget(uint64_t limit)
+    : limit_(limit)
+      , used_(0)
+      , peak_(0) {}
+
+void MemoryBudget::Reserve(uint64_t bytes) {
+    auto used = used_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    auto peak = peak_.load(std::memory_order_relaxed);
+    while (used > peak && !peak_.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {}
+}
+
+void MemoryBudget::Release(uint64_t bytes) {
+    used_.fetch_sub(bytes, std::memory_order_relaxed);
+}
@@ -0,0 +1,214 @@
+#include "merge.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <htslib/bgzf.h>
+#include <htslib/sam.h>
+#include <pbbam/BamReader.h>
+#include <pbbam/PbiFile.h>
+#include <pbbam/PbiRawData.h>
+#include "common.hpp"
+
+using namespace std;
+using namespace PacBio::BAM;
+
+namespace {
+
+// the empty block htslib closes every BGZF file with
+const char kBgzfEof[] = "\037\213\010\4\0\0\0\0\0\377\6\0\102\103\2\0\033\0\3\0\0\0\0\0\0\0\0\0";
+constexpr size_t kBgzfEofSize = sizeof(kBgzfEof) - 1;
+
+constexpr size_t kCopyBufferSize = 4 << 20;
+
+// where one input's record blocks start and end, as file offsets
+struct BlockRange {
+    int64_t begin;
+    int64_t end;
+};
+
+set<string> ReadGroupIds(const string& file) {
+    BamReader reader(file);
+    set<string> ids;
+    for (const auto& rg : reader.Header().ReadGroups()) {
+        ids.insert(rg.Id());
+    }
+    return ids;
+}
+
+// the part of @file after its header and before its EOF marker; the header is handed out if asked for
+BlockRange RecordBlocks(const string& file, bam_hdr_t **header) {
+    BGZF *fp = bgzf_open(file.c_str(), "r");
+    if (fp == nullptr) Utils::Error("failed to open " + file);
+    bam_hdr_t *h = bam_hdr_read(fp);
+    if (h == nullptr) Utils::Error("failed to read the header of " + file);
+    // htslib flushes after the header, so the records start with a block of their own
+    if (fp->block_offset == fp->block_length) {
+        bgzf_read_block(fp);
+    }
+    if (fp->block_offset != 0) {
+        Utils::Error(file + " has records in the same BGZF block as its header, it cannot be merged without "
+                         "recompressing");
+    }
+    BlockRange range;
+    range.begin = fp->block_address;
+    if (header) {
+        *header = h;
+    } else {
+        bam_hdr_destroy(h);
+    }
+    bgzf_close(fp);
+
+    int fd = open(file.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) Utils::Error("failed to open " + file);
+    range.end = st.st_size;
+    char tail[kBgzfEofSize];
+    if (range.end - range.begin >= static_cast<int64_t>(kBgzfEofSize)
+        && pread(fd, tail, kBgzfEofSize, range.end - kBgzfEofSize) == static_cast<ssize_t>(kBgzfEofSize)
+        && memcmp(tail, kBgzfEof, kBgzfEofSize) == 0) {
+        range.end -= kBgzfEofSize;
+    }
+    close(fd);
+    return range;
+}
+
+void CopyBlocks(const string& file, const BlockRange& range, BGZF *out) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) Utils::Error("failed to open " + file);
+    posix_fadvise(fd, range.begin, range.end - range.begin, POSIX_FADV_SEQUENTIAL);
+    unique_ptr<char[]> buffer(new char[kCopyBufferSize]);
+    for (int64_t pos = range.begin; pos < range.end;) {
+        auto n = pread(fd, buffer.get(), static_cast<size_t>(min<int64_t>(kCopyBufferSize, range.end - pos)), pos);
+        if (n <= 0) Utils::Error("failed to read " + file);
+        if (bgzf_raw_write(out, buffer.get(), static_cast<size_t>(n)) != n) {
+            Utils::Error("failed to write the merged output");
+        }
+        pos += n;
+    }
+    close(fd);
+}
+
+template <class T>
+void WriteColumn(BGZF *fp, const vector<T>& column) {
+    if (!column.empty() && bgzf_write(fp, column.data(), column.size() * sizeof(T)) < 0) {
+        Utils::Error("failed to write the merged index");
+    }
+}
+
+template <class T>
+void Append(vector<T>& to, const vector<T>& from) {
+    to.insert(to.end(), from.begin(), from.end());
+}
+
+// the basic section, and the barcode section if every input has one, as laid out in PBI 3.0.1
+void WritePbi(const string& file, const PbiRawBasicData& basic, const PbiRawBarcodeData *barcodes) {
+    BGZF *fp = bgzf_open(file.c_str(), "wb");
+    if (fp == nullptr) Utils::Error("failed to open " + file);
+    uint32_t version = PbiFile::Version_3_0_1;
+    uint16_t sections = barcodes ? (PbiFile::BASIC | PbiFile::BARCODE) : PbiFile::BASIC;
+    uint32_t num_reads = static_cast<uint32_t>(basic.holeNumber_.size());
+    char reserved[18] = {};
+    if (bgzf_write(fp, "PBI\1", 4) < 0
+        || bgzf_write(fp, &version, sizeof(version)) < 0
+        || bgzf_write(fp, &sections, sizeof(sections)) < 0
+        || bgzf_write(fp, &num_reads, sizeof(num_reads)) < 0
+        || bgzf_write(fp, reserved, sizeof(reserved)) < 0) {
+        Utils::Error("failed to write the merged index");
+    }
+    WriteColumn(fp, basic.rgId_);
+    WriteColumn(fp, basic.qStart_);
+    WriteColumn(fp, basic.qEnd_);
+    WriteColumn(fp, basic.holeNumber_);
+    WriteColumn(fp, basic.readQual_);
+    WriteColumn(fp, basic.ctxtFlag_);
+    WriteColumn(fp, basic.fileOffset_);
+    if (barcodes) {
+        WriteColumn(fp, barcodes->bcForward_);
+        WriteColumn(fp, barcodes->bcReverse_);
+        WriteColumn(fp, barcodes->bcQual_);
+    }
+    if (bgzf_close(fp) != 0) Utils::Error("failed to write " + file);
+}
+
+}
+
+void MergeBams(const vector<string>& inputs, const string& output, bool with_index) {
+    if (inputs.empty()) Utils::Error("nothing to merge");
+    auto read_groups = ReadGroupIds(inputs.front());
+    for (size_t i = 1; i < inputs.size(); ++i) {
+        if (ReadGroupIds(inputs[i]) != read_groups) {
+            Utils::Error(inputs[i] + " does not have the same read groups as " + inputs.front());
+        }
+    }
+
+    BGZF *out = bgzf_open(output.c_str(), "wb");
+    if (out == nullptr) Utils::Error("failed to open " + output);
+    bam_hdr_t *header = nullptr;
+    vector<BlockRange> ranges;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        ranges.push_back(RecordBlocks(inputs[i], i == 0 ? &header : nullptr));
+    }
+    if (bam_hdr_write(out, header) != 0 || bgzf_flush(out) != 0) {
+        Utils::Error("failed to write the header of " + output);
+    }
+    bam_hdr_destroy(header);
+
+    // where the blocks of every input start in the output; bgzf_raw_write() does not move the
+    // block address bgzf_tell() reports, so the position is counted here
+    vector<int64_t> bases;
+    int64_t position = bgzf_tell(out) >> 16;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        bases.push_back(position);
+        CopyBlocks(inputs[i], ranges[i], out);
+        position += ranges[i].end - ranges[i].begin;
+    }
+    if (bgzf_close(out) != 0) Utils::Error("failed to close " + output);
+    if (!with_index) return;
+
+    PbiRawBasicData basic;
+    PbiRawBarcodeData barcodes;
+    bool all_barcoded = true;
+    bool any_barcoded = false;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        auto pbi_file = inputs[i] + ".pbi";
+        if (access(pbi_file.c_str(), F_OK) == -1) {
+            Utils::Warning(pbi_file + " does not exist, no index is written for " + output);
+            return;
+        }
+        PbiRawData index(pbi_file);
+        if (index.HasMappedData() || index.HasReferenceData()) {
+            Utils::Warning(pbi_file + " indexes mapped reads, no index is written for " + output);
+            return;
+        }
+        auto first = basic.fileOffset_.size();
+        const auto& in = index.BasicData();
+        Append(basic.rgId_, in.rgId_);
+        Append(basic.qStart_, in.qStart_);
+        Append(basic.qEnd_, in.qEnd_);
+        Append(basic.holeNumber_, in.holeNumber_);
+        Append(basic.readQual_, in.readQual_);
+        Append(basic.ctxtFlag_, in.ctxtFlag_);
+        Append(basic.fileOffset_, in.fileOffset_);
+        // virtual offsets: block address in the upper 48 bits, offset inside the block below
+        auto shift = (bases[i] - ranges[i].begin) << 16;
+        for (auto j = first; j < basic.fileOffset_.size(); ++j) {
+            basic.fileOffset_[j] += shift;
+        }
+        all_barcoded = all_barcoded && index.HasBarcodeData();
+        any_barcoded = any_barcoded || index.HasBarcodeData();
+        if (all_barcoded) {
+            const auto& bc = index.BarcodeData();
+            Append(barcodes.bcForward_, bc.bcForward_);
+            Append(barcodes.bcReverse_, bc.bcReverse_);
+            Append(barcodes.bcQual_, bc.bcQual_);
+        }
+    }
+    if (any_barcoded && !all_barcoded) {
+        Utils::Warning("not every input index has barcodes, the merged index of " + output + " has none");
+    }
+    WritePbi(output + ".pbi", basic, all_barcoded ? &barcodes : nullptr);
+}
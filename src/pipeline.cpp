@@ -0,0 +1,354 @@
+#include "pipeline.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <thread>
+
+using namespace std;
+using namespace PacBio::BAM;
+
+constexpr size_t Pipeline::kAdaptiveMaxRecords;
+constexpr uint64_t Pipeline::kAdaptiveInitialBases;
+constexpr uint64_t Pipeline::kBatchBytesPerBase;
+
+namespace {
+
+class StageTimer {
+public:
+    explicit StageTimer(uint64_t& total)
+        : total_(total)
+          , start_(chrono::steady_clock::now()) {}
+
+    ~StageTimer() {
+        total_ += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    uint64_t& total_;
+    chrono::steady_clock::time_point start_;
+};
+
+// first touch decides where pages land, so a node's batches are allocated by a thread on it
+unique_ptr<Pipeline::pool_type> NewPoolOnNode(const CpuTopology *topology
+                                              , size_t node
+                                              , size_t num_batches
+                                              , size_t batch_capacity
+                                             ) {
+    unique_ptr<Pipeline::pool_type> pool;
+    auto allocate = [&] { pool.reset(new Pipeline::pool_type(num_batches, batch_capacity)); };
+    if (topology == nullptr) {
+        allocate();
+        return pool;
+    }
+    thread t([&] {
+        PinCurrentThread(topology->Cpus(node).front());
+        allocate();
+    });
+    t.join();
+    return pool;
+}
+
+}
+
+Pipeline::Pipeline(const vector<PipelineInput>& inputs
+                   , const SplitterOptions& options
+                   , const PipelineOptions& pipeline_options
+                  )
+    : options_(options)
+      , inputs_(inputs)
+      , current_input_(0)
+      , workers_(pipeline_options.num_threads, pipeline_options.topology)
+      , sizer_(pipeline_options.adaptive_batch_size ? new AdaptiveBatchSizer(kAdaptiveInitialBases) : nullptr)
+      , budget_(pipeline_options.max_memory)
+      , max_batch_bases_(SIZE_MAX)
+      , after_write_(pipeline_options.after_write)
+      , sidecar_out_(pipeline_options.sidecar_out)
+      , sidecar_in_(pipeline_options.sidecar_in)
+      , sweep_(pipeline_options.sweep)
+      , lock_wait_ns_(0)
+      , reported_lock_wait_ns_(0)
+      , reading_(false)
+      , eof_(false)
+      , next_read_(0)
+      , writing_(false)
+      , next_write_(0)
+      , records_in_(0)
+      , bases_in_(0)
+      , window_hits_(0)
+      , rescued_hits_(0)
+      , triaged_{}
+      , sweep_stats_(sweep_ ? sweep_->size() : 0) {
+    copy(begin(pipeline_options.category_writers), end(pipeline_options.category_writers), category_writers_);
+    for (const auto& input : inputs_) {
+        queues_.emplace_back(new queue_type(*input.reader
+                                            , pipeline_options.adaptive_batch_size ? kAdaptiveMaxRecords
+                                                                                   : pipeline_options.batch_size));
+    }
+    for (size_t i = 0; i < workers_.Size(); ++i) {
+        splitters_.emplace_back(new BamSplitter(options_));
+    }
+    for (size_t node = 0; node < workers_.NumNodes(); ++node) {
+        // enough batches for every worker to have one in a parallel stage while the reader and
+        // the writer each hold another
+        batches_.push_back(NewPoolOnNode(pipeline_options.topology
+                                         , node
+                                         , 2 * workers_.WorkersOnNode(node) + 2
+                                         , pipeline_options.batch_size));
+    }
+    if (pipeline_options.max_memory) {
+        max_batch_bases_ = pipeline_options.max_memory / NumBatches() / kBatchBytesPerBase;
+    }
+}
+
+size_t Pipeline::PeakBatchesInFlight() const {
+    size_t peak = 0;
+    for (const auto& pool : batches_) {
+        peak += pool->PeakInFlight();
+    }
+    return peak;
+}
+
+size_t Pipeline::NumBatches() const {
+    size_t n = 0;
+    for (const auto& pool : batches_) {
+        n += pool->Size();
+    }
+    return n;
+}
+
+void Pipeline::Run() {
+    {
+        lock_guard<mutex> lock(mx_);
+        reading_ = true;
+    }
+    workers_.Submit([this](size_t) { _read(); }, _reader_node());
+    workers_.Wait();
+}
+
+size_t Pipeline::_reader_node() const {
+    if (inputs_.empty()) return 0;
+    // past the last input once it is exhausted
+    const auto& input = inputs_[min(current_input_, inputs_.size() - 1)];
+    return min(input.reader_node, workers_.NumNodes() - 1);
+}
+
+size_t Pipeline::_writer_node(size_t input) const {
+    return min(inputs_[input].writer_node, workers_.NumNodes() - 1);
+}
+
+void Pipeline::_read() {
+    Batch *batch;
+    {
+        TimedLockGuard lock(mx_, lock_wait_ns_);
+        batch = nullptr;
+        if (!budget_.Exhausted()) {
+            // spread batches over the nodes, falling back to whichever has one free
+            for (size_t i = 0; i < batches_.size() && batch == nullptr; ++i) {
+                auto node = (next_read_ + i) % batches_.size();
+                batch = batches_[node]->TryAcquire();
+                if (batch) batch->node = node;
+            }
+        }
+        if (batch == nullptr) {
+            // park; the writer starts reading again when it hands a batch back
+            reading_ = false;
+            return;
+        }
+    }
+    auto max_bases = sizer_ ? static_cast<size_t>(sizer_->TargetBases()) : SIZE_MAX;
+    // a single record larger than that still makes a batch of its own
+    max_bases = min(max_bases, max(max_batch_bases_, size_t(1)));
+    // move on to the next input as soon as one is exhausted, its tail is still in flight
+    while (current_input_ < queues_.size() && !queues_[current_input_]->FillAndPop(batch->records, max_bases, options_.by_zmw)) {
+        ++current_input_;
+    }
+    if (current_input_ == queues_.size()) {
+        SidecarRow row;
+        if (sidecar_in_ && sidecar_in_->Next(row)) {
+            Utils::Warning("the sidecar has more rows than the input has reads, "
+                           + to_string(sidecar_in_->RowsRead() - 1) + " of them were used");
+        }
+        TimedLockGuard lock(mx_, lock_wait_ns_);
+        batches_[batch->node]->Release(batch);
+        eof_ = true;
+        reading_ = false;
+        return;
+    }
+    batch->seq = next_read_++;
+    batch->input = current_input_;
+    // not the reader's position, which is past the next ZMW's first subread with by_zmw
+    batch->input_offset = queues_[current_input_]->Position();
+    if (sidecar_in_) {
+        batch->alignments.reserve(batch->records.size());
+        SidecarRow row;
+        for (size_t i = 0; i < batch->records.size(); ++i) {
+            if (!sidecar_in_->Next(row)) {
+                Utils::Error("the sidecar ends after " + to_string(sidecar_in_->RowsRead())
+                                 + " reads, before the input does");
+            }
+            batch->alignments.push_back(row);
+        }
+    }
+    // what the build stage adds is reserved up front, a batch admitted within the budget
+    // cannot grow past it later on
+    batch->reserved_bytes = batch->WorstCaseBytes();
+    budget_.Reserve(batch->reserved_bytes);
+    workers_.Submit([this, batch](size_t) { _decode(batch); }, batch->node);
+    // one batch per task, so that the reader never holds on to a worker for long
+    workers_.Submit([this](size_t) { _read(); }, _reader_node());
+}
+
+void Pipeline::_decode(Batch *batch) {
+    {
+        StageTimer timer(batch->work_ns);
+        batch->records.Decode();
+    }
+    workers_.Submit([this, batch](size_t worker) { _align(worker, batch); }, batch->node);
+}
+
+void Pipeline::_align(size_t worker, Batch *batch) {
+    {
+        StageTimer timer(batch->work_ns);
+        splitters_[worker]->Align(*batch);
+    }
+    workers_.Submit([this, batch](size_t worker) { _build(worker, batch); }, batch->node);
+}
+
+void Pipeline::_build(size_t worker, Batch *batch) {
+    {
+        StageTimer timer(batch->work_ns);
+        splitters_[worker]->Build(*batch);
+        if (sweep_) {
+            batch->sweep.resize(sweep_->size());
+            Sweep::Evaluate(*sweep_, batch->alignments.data(), batch->alignments.size()
+                            , batch->below_rq.data(), batch->below_rq.size(), batch->sweep);
+        }
+    }
+    // only the arena and the sweep can outgrow the worst case
+    auto bytes = batch->EstimatedBytes();
+    if (bytes > batch->reserved_bytes) {
+        budget_.Reserve(bytes - batch->reserved_bytes);
+        batch->reserved_bytes = bytes;
+    }
+    _enqueue_write(batch);
+}
+
+void Pipeline::_enqueue_write(Batch *batch) {
+    size_t node;
+    {
+        TimedLockGuard lock(mx_, lock_wait_ns_);
+        ready_[batch->seq] = batch;
+        if (writing_ || ready_.begin()->first != next_write_) return;
+        writing_ = true;
+        node = _writer_node(ready_.begin()->second->input);
+    }
+    workers_.Submit([this](size_t) { _write(); }, node);
+}
+
+void Pipeline::_write() {
+    for (;;) {
+        Batch *batch;
+        {
+            TimedLockGuard lock(mx_, lock_wait_ns_);
+            if (ready_.empty() || ready_.begin()->first != next_write_) {
+                writing_ = false;
+                return;
+            }
+            batch = ready_.begin()->second;
+            ready_.erase(ready_.begin());
+        }
+        const auto& data = batch->records;
+        const auto& out = inputs_[batch->input];
+        auto write = [&out](const BamRecord& record) {
+            if (out.index) {
+                int64_t offset;
+                out.writer->Write(record, &offset);
+                out.index->AddRecord(record, offset);
+            } else {
+                out.writer->Write(record);
+            }
+        };
+        if (options_.stats_only) {
+            stats_.Merge(batch->stats);
+        } else if (out.fastx) {
+            out.fastx->Write(batch->text);
+        } else if (options_.keep_unsplit) {
+            // hits are in input order, and so are the outputs cut from them
+            size_t output = 0;
+            auto hit = batch->hits.begin();
+            for (size_t i = 0; i < data.size(); ++i) {
+                bool has_hit = hit != batch->hits.end() && hit->index == i;
+                if (has_hit && hit->num_outputs > 0) {
+                    for (uint8_t k = 0; k < hit->num_outputs; ++k) {
+                        write(data.Output(output++));
+                    }
+                } else {
+                    // no hit, or one whose segments are both shorter than -l: the input record as
+                    // read, its serialized bytes go out unchanged
+                    write(data[i]);
+                }
+                if (has_hit) ++hit;
+            }
+        } else {
+            for (size_t i = 0; i < data.NumOutputs(); ++i) {
+                write(data.Output(i));
+            }
+        }
+        if (!batch->rejected.empty()) {
+            // copies, the batch's records are read into again once it is back in the pool
+            vector<BamRecord> rejected[NUM_READ_CATEGORIES];
+            uint64_t rejected_bytes[NUM_READ_CATEGORIES] = {};
+            for (const auto& r : batch->rejected) {
+                rejected[r.category].push_back(data[r.index]);
+                rejected_bytes[r.category] += Batch::RecordBytes(data[r.index]);
+            }
+            for (size_t c = 0; c < NUM_READ_CATEGORIES; ++c) {
+                if (!category_writers_[c] || rejected[c].empty()) continue;
+                // the copies keep their share of the batch's reservation until they are written
+                auto bytes = min(rejected_bytes[c], batch->reserved_bytes);
+                batch->reserved_bytes -= bytes;
+                category_writers_[c]->Write(move(rejected[c]), &budget_, bytes);
+            }
+        }
+        if (sidecar_out_) {
+            sidecar_out_->Append(batch->alignments.data(), batch->alignments.size());
+        }
+        if (after_write_) {
+            after_write_(inputs_, batch->input, batch->input_offset);
+        }
+        records_in_ += data.size();
+        bases_in_ += data.TotalBases();
+        window_hits_ += batch->window_hits;
+        rescued_hits_ += batch->rescued;
+        for (size_t rule = 0; rule < NUM_TRIAGE_RULES; ++rule) {
+            triaged_[rule] += batch->triaged[rule];
+        }
+        if (sweep_) {
+            Sweep::Add(batch->sweep, sweep_stats_);
+        }
+        if (sizer_) {
+            // only the writer touches reported_lock_wait_ns_
+            uint64_t lock_wait = lock_wait_ns_;
+            for (const auto& queue : queues_) {
+                lock_wait += queue->LockWaitNanos();
+            }
+            sizer_->Update(data.TotalBases(), batch->work_ns, lock_wait - reported_lock_wait_ns_);
+            reported_lock_wait_ns_ = lock_wait;
+        }
+        bool resume_reading = false;
+        {
+            TimedLockGuard lock(mx_, lock_wait_ns_);
+            ++next_write_;
+            budget_.Release(batch->reserved_bytes);
+            batches_[batch->node]->Release(batch);
+            if (!reading_ && !eof_) {
+                reading_ = true;
+                resume_reading = true;
+            }
+        }
+        if (resume_reading) {
+            // the reader is parked, current_input_ is not moving
+            workers_.Submit([this](size_t) { _read(); }, _reader_node());
+        }
+    }
+}
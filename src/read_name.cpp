@@ -0,0 +1,66 @@
+#include "read_name.hpp"
+#include <cstring>
+
+constexpr size_t SubreadNameFormatter::kBufferSize;
+
+bool ParseSubreadName(StringView name, SubreadName& parsed) {
+    auto slash1 = name.find('/');
+    if (slash1 == StringView::npos) return false;
+    parsed.movie = name.substr(0, slash1);
+    name.remove_prefix(slash1 + 1);
+    auto slash2 = name.find('/');
+    if (slash2 == StringView::npos) return false;
+    if (!Utils::StringViewTo(name.substr(0, slash2), parsed.zmw)) return false;
+    name.remove_prefix(slash2 + 1);
+    if (name.substr(0, 3) == "ccs" && (name.size() == 3 || name[3] == '/')) {
+        parsed.ccs = name;
+        parsed.qs = 0;
+        parsed.qe = 0;
+        return true;
+    }
+    parsed.ccs = StringView();
+    auto underscore = name.find('_');
+    if (underscore == StringView::npos) return false;
+    return Utils::StringViewTo(name.substr(0, underscore), parsed.qs)
+        && Utils::StringViewTo(name.substr(underscore + 1), parsed.qe);
+}
+
+StringView SubreadNameFormatter::Format(StringView movie, int32_t zmw, int32_t qs, int32_t qe) {
+    // three int32 with their separators take at most 36 characters
+    if (movie.size() > kBufferSize - 36) {
+        Utils::Error("movie name " + movie.to_string() + " is too long for a read name");
+    }
+    auto movie_len = movie.size();
+    char *p = buffer_;
+    std::memcpy(p, movie.data(), movie_len);
+    p += movie_len;
+    *p++ = '/';
+    p += Utils::FormatInt(zmw, p);
+    *p++ = '/';
+    p += Utils::FormatInt(qs, p);
+    *p++ = '_';
+    p += Utils::FormatInt(qe, p);
+    return StringView(buffer_, static_cast<size_t>(p - buffer_));
+}
+
+StringView SubreadNameFormatter::FormatCcs(StringView movie, int32_t zmw, StringView ccs, int32_t begin, int32_t end) {
+    // the same 36 characters as above plus one more separator
+    if (movie.size() + ccs.size() > kBufferSize - 37) {
+        Utils::Error("movie name " + movie.to_string() + " is too long for a read name");
+    }
+    auto movie_len = movie.size();
+    auto ccs_len = ccs.size();
+    char *p = buffer_;
+    std::memcpy(p, movie.data(), movie_len);
+    p += movie_len;
+    *p++ = '/';
+    p += Utils::FormatInt(zmw, p);
+    *p++ = '/';
+    std::memcpy(p, ccs.data(), ccs_len);
+    p += ccs_len;
+    *p++ = '/';
+    p += Utils::FormatInt(begin, p);
+    *p++ = '_';
+    p += Utils::FormatInt(end, p);
+    return StringView(buffer_, static_cast<size_t>(p - buffer_));
+}
@@ -0,0 +1,178 @@
+#include "read_slicer.hpp"
+#include <cstdint>
+#include <utility>
+
+using namespace PacBio::BAM;
+
+void SetTag(BamRecordImpl& impl, const std::string& name, const Tag& value) {
+    if (!impl.EditTag(name, value)) {
+        impl.AddTag(name, value);
+    }
+}
+
+namespace {
+
+// kinetics of subreads and of ccs strands, and the RS II converted QV strings
+const char *const kPerBaseTags[] = {"ip", "pw", "fi", "fp", "ri", "rp", "dq", "dt", "iq", "mq", "sq", "st"};
+// stored in the orientation of the reverse strand
+const char *const kReversedTags[] = {"ri", "rp"};
+// per pulse in internal-mode BAMs, per base only if no pulse was squashed
+const char *const kPerPulseTags[] = {"pa", "pc", "pd", "pe", "pg", "pi", "pm", "pq", "ps", "pt", "pv", "px", "sf"};
+// arrays of a fixed length, whatever the length of the read
+const char *const kPerReadArrays[] = {"bc", "sn"};
+
+template <size_t N>
+bool IsOneOf(const std::string& name, const char *const (&names)[N]) {
+    for (auto n : names) {
+        if (name == n) return true;
+    }
+    return false;
+}
+
+template <class T>
+T SliceOf(const T& data, int begin, int end, bool reversed) {
+    if (reversed) {
+        auto len = static_cast<int>(data.size());
+        return T(data.cbegin() + (len - end), data.cbegin() + (len - begin));
+    }
+    return T(data.cbegin() + begin, data.cbegin() + end);
+}
+
+}
+
+ReadSlicer::ReadSlicer()
+    : record_(nullptr)
+      , cx_(0)
+      , loaded_(false)
+      , blank_input_(SIZE_MAX)
+      , qualities_loaded_(false) {}
+
+void ReadSlicer::Reset(const BamRecord& record, StringView sequence, size_t input) {
+    record_ = &record;
+    sequence_ = sequence;
+    const auto& impl = record.Impl();
+    cx_ = impl.HasTag("cx") ? impl.TagValue("cx").ToUInt8() : 0;
+    loaded_ = false;
+    qualities_loaded_ = false;
+    if (input != blank_input_) {
+        blank_ = BamRecord(record.Header());
+        blank_.Impl().SetMapped(false);
+        blank_input_ = input;
+    }
+}
+
+void ReadSlicer::_load_tags() {
+    per_read_.clear();
+    per_base_.clear();
+    const auto tags = record_->Impl().Tags();
+    for (const auto& entry : tags) {
+        const auto& name = entry.first;
+        const auto& value = entry.second;
+        bool per_base = IsOneOf(name, kPerBaseTags);
+        bool per_pulse = IsOneOf(name, kPerPulseTags);
+        PerBaseTag t;
+        t.name = name;
+        t.reversed = IsOneOf(name, kReversedTags);
+        t.type = value.Type();
+        size_t length = SIZE_MAX;
+        switch (t.type) {
+            case TagDataType::INT8_ARRAY:
+                t.i8 = value.ToInt8Array();
+                length = t.i8.size();
+                break;
+            case TagDataType::UINT8_ARRAY:
+                t.u8 = value.ToUInt8Array();
+                length = t.u8.size();
+                break;
+            case TagDataType::INT16_ARRAY:
+                t.i16 = value.ToInt16Array();
+                length = t.i16.size();
+                break;
+            case TagDataType::UINT16_ARRAY:
+                t.u16 = value.ToUInt16Array();
+                length = t.u16.size();
+                break;
+            case TagDataType::INT32_ARRAY:
+                t.i32 = value.ToInt32Array();
+                length = t.i32.size();
+                break;
+            case TagDataType::UINT32_ARRAY:
+                t.u32 = value.ToUInt32Array();
+                length = t.u32.size();
+                break;
+            case TagDataType::FLOAT_ARRAY:
+                t.f = value.ToFloatArray();
+                length = t.f.size();
+                break;
+            case TagDataType::STRING:
+                // only a QV or pulse string is per base, RG and the like are not
+                if (per_base || per_pulse) {
+                    t.str = value.ToString();
+                    length = t.str.size();
+                }
+                break;
+            default:
+                break;
+        }
+        if (length == sequence_.size() && !IsOneOf(name, kPerReadArrays)) {
+            per_base_.push_back(std::move(t));
+        } else if (!per_base && !per_pulse) {
+            per_read_[name] = value;
+        }
+    }
+    loaded_ = true;
+}
+
+Tag ReadSlicer::_slice(const PerBaseTag& t, int begin, int end) {
+    switch (t.type) {
+        case TagDataType::INT8_ARRAY:
+            return Tag(SliceOf(t.i8, begin, end, t.reversed));
+        case TagDataType::UINT8_ARRAY:
+            return Tag(SliceOf(t.u8, begin, end, t.reversed));
+        case TagDataType::INT16_ARRAY:
+            return Tag(SliceOf(t.i16, begin, end, t.reversed));
+        case TagDataType::UINT16_ARRAY:
+            return Tag(SliceOf(t.u16, begin, end, t.reversed));
+        case TagDataType::INT32_ARRAY:
+            return Tag(SliceOf(t.i32, begin, end, t.reversed));
+        case TagDataType::UINT32_ARRAY:
+            return Tag(SliceOf(t.u32, begin, end, t.reversed));
+        case TagDataType::FLOAT_ARRAY:
+            return Tag(SliceOf(t.f, begin, end, t.reversed));
+        default:
+            return Tag(SliceOf(t.str, begin, end, t.reversed));
+    }
+}
+
+void ReadSlicer::_start_segment(BamRecord& outbam, int begin, int end, const char *qualities) {
+    // copying the empty record keeps the storage outbam already has
+    outbam = blank_;
+    outbam.Impl().SetSequenceAndQualities(sequence_.data() + begin, static_cast<size_t>(end - begin), qualities);
+}
+
+void ReadSlicer::Slice(BamRecord& outbam, int begin, int end) {
+    if (!loaded_) {
+        _load_tags();
+    }
+    _start_segment(outbam, begin, end, nullptr);
+    tags_ = per_read_;
+    for (const auto& t : per_base_) {
+        tags_[t.name] = _slice(t, begin, end);
+    }
+    outbam.Impl().Tags(tags_);
+}
+
+void ReadSlicer::SliceCcs(BamRecord& outbam, int begin, int end) {
+    if (!loaded_) {
+        _load_tags();
+    }
+    if (!qualities_loaded_) {
+        qualities_ = record_->Impl().Qualities().Fastq();
+        if (qualities_.size() != sequence_.size()) {
+            qualities_.clear();
+        }
+        qualities_loaded_ = true;
+    }
+    _start_segment(outbam, begin, end, qualities_.empty() ? nullptr : qualities_.data() + begin);
+    outbam.Impl().Tags(per_read_);
+}
@@ -0,0 +1,133 @@
+#include "scheduler.hpp"
+#include "common.hpp"
+
+namespace {
+// index of the pool worker running on this thread, or -1 outside of any pool
+thread_local size_t k_worker_id = static_cast<size_t>(-1);
+}
+
+constexpr size_t WorkStealingPool::kAnyNode;
+
+WorkStealingPool::WorkStealingPool(size_t num_workers, const CpuTopology *topology)
+    : queued_(0)
+      , pending_(0)
+      , next_queue_(0)
+      , stop_(false) {
+    if (num_workers == 0) num_workers = 1;
+    auto num_nodes = topology ? topology->NumNodes() : 1;
+    node_workers_.resize(num_nodes);
+    for (size_t i = 0; i < num_workers; ++i) {
+        queues_.emplace_back(new TaskQueue());
+        // contiguous blocks of workers per node, as even as the count allows
+        auto node = i * num_nodes / num_workers;
+        node_of_.push_back(node);
+        if (topology) {
+            const auto& cpus = topology->Cpus(node);
+            cpu_of_.push_back(cpus[node_workers_[node].size() % cpus.size()]);
+        } else {
+            cpu_of_.push_back(-1);
+        }
+        node_workers_[node].push_back(i);
+    }
+    if (num_workers < num_nodes) {
+        Utils::Warning(std::to_string(num_workers) + " workers for " + std::to_string(num_nodes)
+                           + " NUMA nodes, tasks for a node without workers run on any of them");
+    }
+    for (size_t i = 0; i < num_workers; ++i) {
+        workers_.emplace_back(&WorkStealingPool::_run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(mx_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& t : workers_) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+}
+
+void WorkStealingPool::Submit(Task task, size_t node) {
+    ++pending_;
+    size_t id;
+    // with fewer workers than nodes some nodes have none, their tasks go wherever
+    if (node >= node_workers_.size() || node_workers_[node].empty()) {
+        id = k_worker_id < queues_.size() ? k_worker_id : next_queue_++ % queues_.size();
+    } else if (k_worker_id < queues_.size() && node_of_[k_worker_id] == node) {
+        id = k_worker_id;
+    } else {
+        const auto& workers = node_workers_[node];
+        id = workers[next_queue_++ % workers.size()];
+    }
+    {
+        // counted under mx_ so that a worker about to sleep cannot miss it, and before the task
+        // is visible so that a worker stealing it cannot take the count below zero
+        std::lock_guard<std::mutex> lock(mx_);
+        ++queued_;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[id]->mx);
+        queues_[id]->tasks.push_back(std::move(task));
+    }
+    work_cv_.notify_one();
+}
+
+void WorkStealingPool::Wait() {
+    std::unique_lock<std::mutex> lock(mx_);
+    idle_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+bool WorkStealingPool::_pop(size_t id, Task& task) {
+    // own work first, newest first
+    {
+        auto& q = *queues_[id];
+        std::lock_guard<std::mutex> lock(q.mx);
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+            return true;
+        }
+    }
+    // then steal the oldest task of somebody else, on the same node first
+    for (int same_node = 1; same_node >= 0; --same_node) {
+        for (size_t i = 1; i < queues_.size(); ++i) {
+            auto victim = (id + i) % queues_.size();
+            if ((node_of_[victim] == node_of_[id]) != static_cast<bool>(same_node)) continue;
+            auto& q = *queues_[victim];
+            std::lock_guard<std::mutex> lock(q.mx);
+            if (!q.tasks.empty()) {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::_run(size_t id) {
+    k_worker_id = id;
+    if (cpu_of_[id] >= 0 && !PinCurrentThread(cpu_of_[id])) {
+        Utils::Warning("failed to pin worker " + std::to_string(id) + " to cpu " + std::to_string(cpu_of_[id]));
+    }
+    Task task;
+    for (;;) {
+        if (_pop(id, task)) {
+            --queued_;
+            task(id);
+            task = nullptr;
+            if (--pending_ == 0) {
+                std::lock_guard<std::mutex> lock(mx_);
+                idle_cv_.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mx_);
+        work_cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+        if (stop_) return;
+    }
+}
@@ -0,0 +1,100 @@
+#include "shard.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <random>
+#include <pbbam/PbiFilterTypes.h>
+
+using namespace std;
+using namespace PacBio::BAM;
+
+namespace Shard {
+
+bool ParseShard(const StringView& s, size_t& shard, size_t& num_shards) {
+    auto fields = Utils::Tokenize(s, '/');
+    return fields.size() == 2
+        && Utils::StringViewTo(fields[0], shard)
+        && Utils::StringViewTo(fields[1], num_shards)
+        && shard < num_shards;
+}
+
+bool ParseZmwRange(const StringView& s, ZmwRange& range) {
+    auto fields = Utils::Tokenize(s, '-');
+    int32_t first, last;
+    if (fields.size() != 2
+        || !Utils::StringViewTo(fields[0], first)
+        || !Utils::StringViewTo(fields[1], last)
+        || first > last) {
+        return false;
+    }
+    range.begin = first;
+    range.end = last == INT32_MAX ? INT32_MAX : last + 1;
+    return true;
+}
+
+bool SortedByZmw(const PbiRawData& index) {
+    const auto& zmws = index.BasicData().holeNumber_;
+    return is_sorted(zmws.begin(), zmws.end());
+}
+
+ZmwRange ShardRange(const PbiRawData& index, size_t shard, size_t num_shards) {
+    const auto& zmws = index.BasicData().holeNumber_;
+    auto n = zmws.size();
+    // move a cut forward to the first subread of the next ZMW
+    auto cut = [&](size_t i) {
+        i = static_cast<size_t>(static_cast<uint64_t>(n) * i / num_shards);
+        while (i > 0 && i < n && zmws[i] == zmws[i - 1]) ++i;
+        return i;
+    };
+    auto first = cut(shard);
+    auto last = cut(shard + 1);
+    ZmwRange range;
+    if (first >= n) {
+        // a shard past the last ZMW, of more shards than ZMWs
+        range.begin = INT32_MIN;
+        range.end = INT32_MIN;
+        return range;
+    }
+    range.begin = first == 0 ? INT32_MIN : zmws[first];
+    // the last shard takes everything up to and including INT32_MAX
+    range.end = last < n ? zmws[last] : INT32_MAX;
+    return range;
+}
+
+PbiFilter RangeFilter(const ZmwRange& range) {
+    if (range.end == INT32_MAX) {
+        return PbiFilter(PbiZmwFilter(range.begin, Compare::GREATER_THAN_EQUAL));
+    }
+    return PbiFilter::Intersection({PbiZmwFilter(range.begin, Compare::GREATER_THAN_EQUAL)
+                                    , PbiZmwFilter(range.end, Compare::LESS_THAN)});
+}
+
+vector<int32_t> SampleZmws(const PbiRawData& index, double fraction, size_t num_zmws, uint64_t seed, ZmwSample& sample) {
+    const auto& holes = index.BasicData().holeNumber_;
+    vector<int32_t> zmws(holes.begin(), holes.end());
+    sort(zmws.begin(), zmws.end());
+    zmws.erase(unique(zmws.begin(), zmws.end()), zmws.end());
+    auto n = zmws.size();
+    auto k = num_zmws ? num_zmws : static_cast<size_t>(llround(fraction * n));
+    k = min(max<size_t>(k, 1), n);
+    // a partial Fisher-Yates shuffle; mt19937_64 is the same everywhere, unlike the distributions
+    mt19937_64 rng(seed);
+    for (size_t i = 0; i < k; ++i) {
+        swap(zmws[i], zmws[i + rng() % (n - i)]);
+    }
+    zmws.resize(k);
+    sort(zmws.begin(), zmws.end());
+    sample.zmws += n;
+    sample.records += holes.size();
+    sample.sampled_zmws += k;
+    for (auto zmw : holes) {
+        if (binary_search(zmws.begin(), zmws.end(), zmw)) ++sample.sampled_records;
+    }
+    return zmws;
+}
+
+PbiFilter ZmwFilter(const vector<int32_t>& zmws) {
+    return PbiZmwFilter(zmws);
+}
+
+}
@@ -0,0 +1,155 @@
+#include "sidecar.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include "common.hpp"
+
+using namespace std;
+
+namespace {
+
+const char kMagic[] = "SPLITSC1";
+constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+
+size_t Padded(size_t bytes) {
+    return (bytes + 7) & ~size_t(7);
+}
+
+// the header up to and including the primer, without the padding
+string Header(const SplitterOptions& options) {
+    string header(kMagic, kMagicSize);
+    uint32_t fields[] = {options.match_score, options.mismatch_penalty, options.gap_open_penalty
+                         , options.gap_ext_penalty, static_cast<uint32_t>(options.primer_seq.size())};
+    header.append(reinterpret_cast<const char *>(fields), sizeof(fields));
+    header += options.primer_seq;
+    return header;
+}
+
+}
+
+SidecarWriter::SidecarWriter(const string& file, const SplitterOptions& options)
+    : file_(file)
+      , out_(fopen(file.c_str(), "wb")) {
+    if (out_ == nullptr) {
+        Utils::Error("failed to open " + file + " for writing");
+    }
+    auto header = Header(options);
+    header.resize(Padded(header.size()), '\0');
+    _write(header.data(), header.size());
+}
+
+SidecarWriter::~SidecarWriter() {
+    if (fclose(out_) != 0) {
+        Utils::Error("failed to finish " + file_);
+    }
+}
+
+void SidecarWriter::_write(const void *data, size_t bytes) {
+    if (fwrite(data, 1, bytes, out_) != bytes) {
+        Utils::Error("failed to write to " + file_);
+    }
+}
+
+template <class T>
+void SidecarWriter::_write_column(const SidecarRow *rows, size_t n, T SidecarRow::*column) {
+    column_.assign(Padded(n * sizeof(T)), '\0');
+    auto *values = reinterpret_cast<T *>(column_.data());
+    for (size_t i = 0; i < n; ++i) {
+        values[i] = rows[i].*column;
+    }
+    _write(column_.data(), column_.size());
+}
+
+void SidecarWriter::Append(const SidecarRow *rows, size_t n) {
+    if (n == 0) return;
+    uint64_t num_rows = n;
+    _write(&num_rows, sizeof(num_rows));
+    _write_column(rows, n, &SidecarRow::zmw);
+    _write_column(rows, n, &SidecarRow::qs);
+    _write_column(rows, n, &SidecarRow::qe);
+    _write_column(rows, n, &SidecarRow::sw_score);
+    _write_column(rows, n, &SidecarRow::sw_score_next_best);
+    _write_column(rows, n, &SidecarRow::ref_begin);
+    _write_column(rows, n, &SidecarRow::ref_end);
+}
+
+SidecarReader::SidecarReader(const string& file, const SplitterOptions& options)
+    : file_(file)
+      , data_(nullptr)
+      , size_(0)
+      , offset_(0)
+      , block_rows_(0)
+      , block_row_(0)
+      , rows_read_(0) {
+    int fd = open(file.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0) {
+        Utils::Error("failed to open " + file);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+        void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            Utils::Error("failed to map " + file);
+        }
+        data_ = static_cast<const char *>(p);
+        // read front to back exactly once
+        madvise(p, size_, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    if (size_ < kMagicSize || memcmp(data_, kMagic, kMagicSize) != 0) {
+        Utils::Error(file + " is not a sidecar written by --sidecar");
+    }
+    auto header = Header(options);
+    if (size_ < header.size() || memcmp(data_, header.data(), header.size()) != 0) {
+        Utils::Error("the alignments in " + file + " were made with another primer or other -M, -S, -O or -E, "
+                         "only -m, -f and -l can be applied again");
+    }
+    offset_ = Padded(header.size());
+}
+
+SidecarReader::~SidecarReader() {
+    if (data_) munmap(const_cast<char *>(data_), size_);
+}
+
+bool SidecarReader::_load_block() {
+    if (offset_ + sizeof(uint64_t) > size_) return false;
+    memcpy(&block_rows_, data_ + offset_, sizeof(uint64_t));
+    size_t offset = offset_ + sizeof(uint64_t);
+    auto column = [&](size_t value_size) {
+        const char *p = data_ + offset;
+        offset += Padded(block_rows_ * value_size);
+        return p;
+    };
+    zmw_ = reinterpret_cast<const int32_t *>(column(sizeof(int32_t)));
+    qs_ = reinterpret_cast<const int32_t *>(column(sizeof(int32_t)));
+    qe_ = reinterpret_cast<const int32_t *>(column(sizeof(int32_t)));
+    sw_score_ = reinterpret_cast<const uint16_t *>(column(sizeof(uint16_t)));
+    sw_score_next_best_ = reinterpret_cast<const uint16_t *>(column(sizeof(uint16_t)));
+    ref_begin_ = reinterpret_cast<const int32_t *>(column(sizeof(int32_t)));
+    ref_end_ = reinterpret_cast<const int32_t *>(column(sizeof(int32_t)));
+    if (offset > size_) {
+        Utils::Error(file_ + " is truncated");
+    }
+    offset_ = offset;
+    block_row_ = 0;
+    return true;
+}
+
+bool SidecarReader::Next(SidecarRow& row) {
+    while (block_row_ == block_rows_) {
+        if (!_load_block()) return false;
+    }
+    auto i = block_row_++;
+    row.zmw = zmw_[i];
+    row.qs = qs_[i];
+    row.qe = qe_[i];
+    row.sw_score = sw_score_[i];
+    row.sw_score_next_best = sw_score_next_best_[i];
+    row.ref_begin = ref_begin_[i];
+    row.ref_end = ref_end_[i];
+    ++rows_read_;
+    return true;
+}
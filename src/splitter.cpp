@@ -0,0 +1,520 @@
+#include "splitter.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include "common.hpp"
+
+using namespace std;
+using namespace PacBio::BAM;
+
+namespace {
+
+template <bool is_left>
+void SplitBam(ReadSlicer& read
+              , BamRecord& outbam
+              , const SubreadName& name
+              , SubreadNameFormatter& formatter
+              , string& name_buffer
+              , const AdapterHit& alignment
+             ) {
+    int left_start = name.qs;
+    int right_end = name.qe;
+    // sequence and per-base tags
+    if (is_left) {
+        read.Slice(outbam, 0, alignment.ref_begin);
+    } else {
+        read.Slice(outbam, alignment.ref_end + 1, static_cast<int>(read.Sequence().size()));
+    }
+    // name
+    auto new_name = is_left ?
+                    formatter.Format(name.movie, name.zmw, left_start, left_start + alignment.ref_begin) :
+                    formatter.Format(name.movie, name.zmw, left_start + alignment.ref_end + 1, right_end);
+    name_buffer.assign(new_name.data(), new_name.size());
+    auto& impl = outbam.Impl();
+    impl.Name(name_buffer);
+    // special tag
+    SetTag(impl, "qs", Tag(is_left ? left_start : left_start + alignment.ref_end + 1));
+    SetTag(impl, "qe", Tag(is_left ? left_start + alignment.ref_begin : right_end));
+    SetTag(impl, "cx", Tag(static_cast<uint8_t>(
+        read.LocalContext()
+            | (is_left ? PacBio::BAM::LocalContextFlags::ADAPTER_BEFORE : PacBio::BAM::LocalContextFlags::ADAPTER_AFTER)
+    )));
+}
+
+// a CCS read has no subread tags to fix, only its name, sequence and qualities change
+void SplitCcsBam(ReadSlicer& read
+                 , BamRecord& outbam
+                 , StringView new_name
+                 , string& name_buffer
+                 , int begin
+                 , int end
+                ) {
+    read.SliceCcs(outbam, begin, end);
+    name_buffer.assign(new_name.data(), new_name.size());
+    outbam.Impl().Name(name_buffer);
+}
+
+// with by_zmw, how far from a sibling's adapter one is looked for: the primer length plus this
+// fraction of the sibling's adapter position, i.e. of the insert length
+constexpr int32_t kZmwSlackDivisor = 20;
+// and how close to -m a hit at that position has to come to be taken, 3/4 of it
+constexpr int32_t kRescueNumerator = 3;
+constexpr int32_t kRescueDenominator = 4;
+
+bool SameZmw(const RecordBatch<BamRecord>::Meta& a, const RecordBatch<BamRecord>::Meta& b) {
+    return a.parsed && b.parsed && a.name.zmw == b.name.zmw && a.name.movie == b.name.movie;
+}
+
+// movie/zmw/qs_qe of a subread segment, movie/zmw/ccs/qs_qe of a CCS one
+StringView SegmentName(SubreadNameFormatter& formatter, const SubreadName& name, int32_t qs, int32_t qe) {
+    return name.ccs.empty() ? formatter.Format(name.movie, name.zmw, qs, qe)
+                            : formatter.FormatCcs(name.movie, name.zmw, name.ccs, qs, qe);
+}
+
+// sequence, qualities and the two kinetics tracks of a subread, per base
+constexpr uint64_t kRecordBytesPerBase = 4;
+// bam1_t, name and the remaining tags
+constexpr uint64_t kRecordBytesOverhead = 256;
+
+}
+
+Batch::Batch()
+    : hits(ArenaAllocator<AdapterHit>(arena))
+      , rejected(ArenaAllocator<RejectedRead>(arena))
+      , alignments(ArenaAllocator<SidecarRow>(arena))
+      , below_rq(ArenaAllocator<size_t>(arena))
+      , seq(0)
+      , input(0)
+      , input_offset(0)
+      , work_ns(0)
+      , reserved_bytes(0)
+      , window_hits(0)
+      , rescued(0)
+      , triaged{}
+      , node(0) {}
+
+void Batch::clear() {
+    records.clear();
+    // let go of the arena memory before the arena hands it out again
+    ArenaVector<AdapterHit>(hits.get_allocator()).swap(hits);
+    ArenaVector<RejectedRead>(rejected.get_allocator()).swap(rejected);
+    ArenaVector<SidecarRow>(alignments.get_allocator()).swap(alignments);
+    ArenaVector<size_t>(below_rq.get_allocator()).swap(below_rq);
+    arena.Reset();
+    text.clear();
+    fill(sweep.begin(), sweep.end(), SweepStats());
+    stats.Clear();
+    seq = 0;
+    input = 0;
+    input_offset = 0;
+    work_ns = 0;
+    reserved_bytes = 0;
+    window_hits = 0;
+    rescued = 0;
+    fill(begin(triaged), end(triaged), 0);
+}
+
+uint64_t Batch::EstimatedBytes() const {
+    uint64_t bytes = records.BufferBytes() + arena.Reserved() + text.capacity();
+    for (const auto& r : records) {
+        bytes += RecordBytes(r);
+    }
+    for (size_t i = 0; i < records.NumOutputs(); ++i) {
+        bytes += RecordBytes(records.Output(i));
+    }
+    return bytes;
+}
+
+uint64_t Batch::WorstCaseBytes() const {
+    uint64_t bytes = EstimatedBytes();
+    // the segments share the bases of the read, but each has a record of its own
+    for (const auto& r : records) {
+        bytes += RecordBytes(r) + kRecordBytesOverhead;
+    }
+    return bytes;
+}
+
+uint64_t Batch::RecordBytes(const BamRecord& r) {
+    return r.Impl().SequenceLength() * kRecordBytesPerBase + kRecordBytesOverhead;
+}
+
+BamSplitter::BamSplitter(const SplitterOptions& options)
+    : options_(options)
+      , aligner_{}
+      // only the positions are used, skip building the cigar
+      , filter_{true, false, 0, 32767}
+      , min_split_length_(0)
+      , min_hit_score_(options.min_sw_score)
+      , primer_counts_{}
+      , qualities_of_(SIZE_MAX) {
+    int8_t scoring_matrix[25];
+    _prepare_scoring_matrix(scoring_matrix);
+    aligner_.Clear();
+    aligner_.RebuildScoreMatrix(scoring_matrix, 5);
+    aligner_.SetGapPenalty(options_.gap_open_penalty, options_.gap_ext_penalty);
+    // the primer is the query of every alignment, translated and profiled once
+    aligner_.SetQuerySequence(options_.primer_seq.data(), static_cast<int>(options_.primer_seq.size()));
+    if (options_.by_zmw) {
+        // a sibling's strong hit can rescue a read scoring less than -m
+        min_hit_score_ = static_cast<uint16_t>((options_.min_sw_score * kRescueNumerator + kRescueDenominator - 1)
+                                               / kRescueDenominator);
+    }
+    if (options_.match_score > 0) {
+        // every base of a hit scores at most a match, so it spans at least this many bases
+        int32_t min_hit_length = (min_hit_score_ + options_.match_score - 1) / options_.match_score;
+        min_split_length_ = options_.min_len + 1 + min_hit_length;
+    }
+    vector<int8_t> primer_codes(options_.primer_seq.size());
+    StripedSmithWaterman::TranslateBases(options_.primer_seq.data()
+                                         , static_cast<int>(primer_codes.size())
+                                         , primer_codes.data());
+    for (auto c : primer_codes) {
+        ++primer_counts_[min<int8_t>(c, 4)];
+    }
+}
+
+TriageRule BamSplitter::Triage(const RecordBatch<BamRecord>& data, size_t index, bool bounds) const {
+    auto length = data.Length(index);
+    if (bounds && length < min_split_length_) {
+        return TRIAGE_LENGTH;
+    }
+    if (options_.min_rq > 0) {
+        const auto& impl = data[index].Impl();
+        if (impl.HasTag("rq") && impl.TagValue("rq").ToFloat() < options_.min_rq) {
+            return TRIAGE_RQ;
+        }
+    }
+    if (!bounds) {
+        return NUM_TRIAGE_RULES;
+    }
+    // the best a hit can do is to match every base of the primer to a base of the read; counted
+    // branch-free over the translated read, one base at a time, which the compiler vectorises
+    const int8_t *codes = data.Codes(index);
+    uint32_t counts[5];
+    for (int8_t b = 0; b < 5; ++b) {
+        uint32_t n = 0;
+        for (int32_t j = 0; j < length; ++j) {
+            n += codes[j] == b;
+        }
+        counts[b] = n;
+    }
+    uint32_t matches = 0;
+    for (int b = 0; b < 4; ++b) {
+        matches += min(counts[b], primer_counts_[b]);
+    }
+    // an N scores half a match against a base: the read's Ns against the primer bases left
+    // unmatched, and every N of the primer against some base of the read
+    auto primer_bases = static_cast<uint32_t>(options_.primer_seq.size()) - primer_counts_[4];
+    auto halves = min(counts[4], primer_bases - matches) + primer_counts_[4];
+    if (matches * options_.match_score + halves * (options_.match_score >> 1) < min_hit_score_) {
+        return TRIAGE_COMPOSITION;
+    }
+    return NUM_TRIAGE_RULES;
+}
+
+void BamSplitter::_prepare_scoring_matrix(int8_t *scoring_matrix) {
+    int i = 0;
+    scoring_matrix[i++] = options_.match_score;       /* A-A */
+    scoring_matrix[i++] = -options_.mismatch_penalty; /* A-C */
+    scoring_matrix[i++] = -options_.mismatch_penalty; /* A-G */
+    scoring_matrix[i++] = -options_.mismatch_penalty; /* A-T */
+    scoring_matrix[i++] = options_.match_score >> 1; /* A-N */
+
+    scoring_matrix[i++] = -options_.mismatch_penalty; /* C-A */
+    scoring_matrix[i++] = options_.match_score;       /* C-C */
+    scoring_matrix[i++] = -options_.mismatch_penalty; /* C-G */
+    scoring_matrix[i++] = -options_.mismatch_penalty; /* C-T */
+    scoring_matrix[i++] = options_.match_score >> 1; /* C-N */
+
+    scoring_matrix[i++] = -options_.mismatch_penalty; /* G-A */
+    scoring_matrix[i++] = -options_.mismatch_penalty; /* G-C */
+    scoring_matrix[i++] = options_.match_score;       /* G-G */
+    scoring_matrix[i++] = -options_.mismatch_penalty; /* G-T */
+    scoring_matrix[i++] = options_.match_score >> 1; /* G-N */
+
+    scoring_matrix[i++] = -options_.mismatch_penalty; /* T-A */
+    scoring_matrix[i++] = -options_.mismatch_penalty; /* T-C */
+    scoring_matrix[i++] = -options_.mismatch_penalty; /* T-G */
+    scoring_matrix[i++] = options_.match_score;       /* T-T */
+    scoring_matrix[i++] = options_.match_score >> 1; /* T-N */
+
+    scoring_matrix[i++] = options_.match_score >> 1;     /* N-A */
+    scoring_matrix[i++] = options_.match_score >> 1;     /* N-C */
+    scoring_matrix[i++] = options_.match_score >> 1;     /* N-G */
+    scoring_matrix[i++] = options_.match_score >> 1;     /* N-T */
+    scoring_matrix[i] = -options_.mismatch_penalty;   /* N-N */
+}
+
+AdapterStats *BamSplitter::_stats(Batch& batch) const {
+    if (!options_.stats_only) return nullptr;
+    batch.stats.Resize(static_cast<size_t>(options_.match_score) * options_.primer_seq.size());
+    return &batch.stats;
+}
+
+void BamSplitter::_count_rejected(AdapterStats& stats, ReadCategory category) {
+    if (category == NO_ADAPTER) {
+        ++stats.no_adapter;
+    } else {
+        ++stats.ambiguous;
+    }
+}
+
+void BamSplitter::_replay(Batch& batch) {
+    auto& data = batch.records;
+    batch.hits.reserve(data.size());
+    auto *stats = _stats(batch);
+    for (size_t i = 0; i < data.size(); ++i) {
+        const auto& row = batch.alignments[i];
+        const auto& meta = data.Metadata(i);
+        if (meta.parsed && meta.name.zmw != row.zmw) {
+            Utils::Error("the sidecar does not belong to the input, it has zmw " + to_string(row.zmw) + " for "
+                             + data[i].FullName());
+        }
+        if (Triage(data, i, false) == TRIAGE_RQ) {
+            ++batch.triaged[TRIAGE_RQ];
+            batch.below_rq.push_back(i);
+            continue;
+        }
+        if (stats) stats->AddAlignment(row.sw_score, row.sw_score_next_best);
+        if (row.sw_score < options_.min_sw_score
+            || row.sw_score - row.sw_score_next_best < options_.min_sw_diff) {
+            auto category = row.sw_score < options_.min_sw_score ? NO_ADAPTER : AMBIGUOUS;
+            if (stats) _count_rejected(*stats, category);
+            if (options_.keep_category[category]) {
+                batch.rejected.push_back(RejectedRead{i, category});
+            }
+            continue;
+        }
+        if (stats) stats->AddHit(row.ref_begin, data.Length(i));
+        batch.hits.push_back(AdapterHit{i, row.sw_score, row.sw_score_next_best, row.ref_begin, row.ref_end, 0});
+    }
+}
+
+void BamSplitter::_align_read(Batch& batch, size_t index) {
+    const auto& data = batch.records;
+    alignment_.Clear();
+    aligner_.Align(data.Codes(index)
+                   , data.Length(index)
+                   , filter_
+                   , &alignment_
+    );
+    if (options_.keep_alignments) {
+        const auto& meta = data.Metadata(index);
+        bool subread = meta.parsed && meta.name.ccs.empty();
+        batch.alignments.push_back(SidecarRow{meta.parsed ? meta.name.zmw : -1
+                                              , subread ? meta.name.qs : 0
+                                              , subread ? meta.name.qe : data.Length(index)
+                                              , alignment_.sw_score
+                                              , alignment_.sw_score_next_best
+                                              , alignment_.ref_begin
+                                              , alignment_.ref_end});
+    }
+}
+
+void BamSplitter::Align(Batch& batch) {
+    if (options_.from_sidecar) {
+        _replay(batch);
+        return;
+    }
+    auto& data = batch.records;
+    batch.hits.reserve(data.size());
+    if (options_.keep_alignments) {
+        batch.alignments.reserve(data.size());
+    }
+    const auto primer_len = static_cast<int32_t>(options_.primer_seq.size());
+    auto *stats = _stats(batch);
+    // a category output needs to know why a read is not split and a sidecar needs every
+    // alignment, only aligning tells; --min-rq decides the same in every mode
+    bool bounds = !options_.keep_alignments
+        && find(begin(options_.keep_category), end(options_.keep_category), true) == end(options_.keep_category);
+    // with by_zmw, where a strong hit put the adapter in an earlier subread of the same ZMW
+    int32_t evidence = -1;
+    for (size_t i = 0; i < data.size(); ++i) {
+        if (options_.by_zmw && (i == 0 || !SameZmw(data.Metadata(i - 1), data.Metadata(i)))) {
+            evidence = -1;
+        }
+        auto rule = Triage(data, i, bounds);
+        if (rule != NUM_TRIAGE_RULES) {
+            ++batch.triaged[rule];
+            if (options_.keep_alignments) {
+                // the sidecar has a row for every read, a replay applies --min-rq again
+                _align_read(batch, i);
+                batch.below_rq.push_back(i);
+            }
+            continue;
+        }
+        int32_t slack = evidence < 0 ? 0 : primer_len + evidence / kZmwSlackDivisor;
+        // a subread long enough to hold another insert after the adapter is searched where its
+        // sibling had one first, and only as a whole if nothing is found there; -f is tested
+        // within the window, the sibling's hit standing in for the rest of the read
+        if (evidence >= 0 && data.Length(i) > evidence + primer_len + options_.min_len) {
+            auto begin = max(0, evidence - slack);
+            auto end = min(data.Length(i), evidence + primer_len + slack);
+            alignment_.Clear();
+            aligner_.Align(data.Codes(i) + begin
+                           , end - begin
+                           , filter_
+                           , &alignment_
+            );
+            if (alignment_.sw_score >= options_.min_sw_score
+                && alignment_.sw_score - alignment_.sw_score_next_best >= options_.min_sw_diff) {
+                if (stats) {
+                    stats->AddAlignment(alignment_.sw_score, alignment_.sw_score_next_best);
+                    stats->AddHit(alignment_.ref_begin + begin, data.Length(i));
+                }
+                batch.hits.push_back(AdapterHit{i
+                                                , alignment_.sw_score
+                                                , alignment_.sw_score_next_best
+                                                , alignment_.ref_begin + begin
+                                                , alignment_.ref_end + begin
+                                                , 0});
+                ++batch.window_hits;
+                continue;
+            }
+        }
+        _align_read(batch, i);
+        if (stats) stats->AddAlignment(alignment_.sw_score, alignment_.sw_score_next_best);
+        // filter
+        if (alignment_.sw_score < options_.min_sw_score
+            || alignment_.sw_score - alignment_.sw_score_next_best < options_.min_sw_diff) {
+            // a borderline hit where a sibling had a strong one is taken after all, as long as it
+            // stands out from the next-best as much as -f asks
+            if (evidence >= 0
+                && alignment_.sw_score * kRescueDenominator >= options_.min_sw_score * kRescueNumerator
+                && alignment_.sw_score - alignment_.sw_score_next_best >= options_.min_sw_diff
+                && abs(alignment_.ref_begin - evidence) <= slack) {
+                if (stats) stats->AddHit(alignment_.ref_begin, data.Length(i));
+                batch.hits.push_back(AdapterHit{i
+                                                , alignment_.sw_score
+                                                , alignment_.sw_score_next_best
+                                                , alignment_.ref_begin
+                                                , alignment_.ref_end
+                                                , 0});
+                ++batch.rescued;
+                continue;
+            }
+            #ifndef NDEBUG
+            fprintf(stderr
+                    , "[%d]\t%d\t%d\t%.*s\n"
+                    , alignment_.sw_score < options_.min_sw_score ? 1 : 2
+                    , alignment_.sw_score
+                    , alignment_.sw_score_next_best
+                    , data.Length(i)
+                    , data.Sequence(i).data());
+            #endif
+            auto category = alignment_.sw_score < options_.min_sw_score ? NO_ADAPTER : AMBIGUOUS;
+            if (stats) _count_rejected(*stats, category);
+            if (options_.keep_category[category]) {
+                batch.rejected.push_back(RejectedRead{i, category});
+            }
+            continue;
+        }
+        if (stats) stats->AddHit(alignment_.ref_begin, data.Length(i));
+        batch.hits.push_back(AdapterHit{i
+                                        , alignment_.sw_score
+                                        , alignment_.sw_score_next_best
+                                        , alignment_.ref_begin
+                                        , alignment_.ref_end
+                                        , 0});
+        if (options_.by_zmw && alignment_.sw_score >= options_.min_sw_score + options_.min_sw_diff) {
+            evidence = alignment_.ref_begin;
+        }
+    }
+}
+
+void BamSplitter::_append_fastx(Batch& batch, size_t index, StringView name, int begin, int end) {
+    const auto& data = batch.records;
+    StringView qualities;
+    if (options_.format == OutputFormat::FASTQ) {
+        if (qualities_of_ != index) {
+            qualities_ = data[index].Impl().Qualities().Fastq();
+            // subreads come without base qualities
+            if (qualities_.size() != static_cast<size_t>(data.Length(index))) {
+                qualities_.assign(static_cast<size_t>(data.Length(index)), '!');
+            }
+            qualities_of_ = index;
+        }
+        qualities = StringView(qualities_).substr(begin, end - begin);
+    }
+    AppendFastx(batch.text, options_.format, name, data.Sequence(index).substr(begin, end - begin), qualities);
+}
+
+void BamSplitter::Build(Batch& batch) {
+    if (options_.stats_only) return;
+    auto& data = batch.records;
+    bool fastx = options_.format != OutputFormat::BAM;
+    qualities_of_ = SIZE_MAX;
+    // with keep_unsplit, the reads before the current hit that have none
+    size_t unsplit = 0;
+    auto append_unsplit = [&](size_t until) {
+        for (; unsplit < until; ++unsplit) {
+            _append_fastx(batch, unsplit, data[unsplit].FullName(), 0, data.Length(unsplit));
+        }
+    };
+    for (auto& hit : batch.hits) {
+        // fix name
+        const auto& meta = data.Metadata(hit.index);
+        if (options_.ccs && !(meta.parsed && !meta.name.ccs.empty())) {
+            Utils::Error("failed to parse movie/zmw/ccs from " + data[hit.index].FullName());
+        }
+        if (!options_.ccs && !(meta.parsed && meta.name.ccs.empty())) {
+            Utils::Error("failed to parse movie/zmw/start_end from " + data[hit.index].FullName()
+                             + (meta.parsed ? ", pass --ccs for CCS reads" : ""));
+        }
+        const auto& name = meta.name;
+        auto read_length = data.Length(hit.index);
+        // a CCS name carries no positions, its segments are named by their positions in the read
+        int32_t qs = options_.ccs ? 0 : name.qs;
+        int32_t qe = options_.ccs ? read_length : name.qe;
+        bool left = hit.ref_begin > options_.min_len;
+        bool right = qs + hit.ref_end + 1 + options_.min_len < qe;
+        if (fastx) {
+            // the records are never built, names and sequences come from the split coordinates
+            if (options_.keep_unsplit) {
+                // a hit whose segments are both shorter than -l leaves the read unsplit as well
+                append_unsplit(left || right ? hit.index : hit.index + 1);
+                unsplit = hit.index + 1;
+            }
+            if (left) {
+                _append_fastx(batch, hit.index, SegmentName(formatter_, name, qs, qs + hit.ref_begin)
+                              , 0, hit.ref_begin);
+            }
+            if (right) {
+                _append_fastx(batch, hit.index, SegmentName(formatter_, name, qs + hit.ref_end + 1, qe)
+                              , hit.ref_end + 1, read_length);
+            }
+            continue;
+        }
+        read_.Reset(data[hit.index], data.Sequence(hit.index), batch.input);
+        // fix sequence
+        if (left) {
+            if (options_.ccs) {
+                SplitCcsBam(read_, data.NewOutput(), SegmentName(formatter_, name, 0, hit.ref_begin), name_buffer_
+                            , 0, hit.ref_begin);
+            } else {
+                SplitBam<true>(read_, data.NewOutput(), name, formatter_, name_buffer_, hit);
+            }
+            ++hit.num_outputs;
+        }
+        if (right) {
+            if (options_.ccs) {
+                SplitCcsBam(read_, data.NewOutput(), SegmentName(formatter_, name, hit.ref_end + 1, qe), name_buffer_
+                            , hit.ref_end + 1, read_length);
+            } else {
+                SplitBam<false>(read_, data.NewOutput(), name, formatter_, name_buffer_, hit);
+            }
+            ++hit.num_outputs;
+        }
+    }
+    if (fastx && options_.keep_unsplit) {
+        append_unsplit(data.size());
+    }
+    if (options_.verbose) {
+        Utils::Info("batch " + to_string(batch.seq) + " of " + to_string(data.size()) + " records, "
+                        + to_string(data.TotalBases()) + " bases: "
+                        + (fastx ? to_string(batch.text.size()) + " bytes of " + (options_.format == OutputFormat::FASTA ? "FASTA" : "FASTQ")
+                                 : to_string(data.NumOutputs()) + " records") + " to write, peak memory "
+                        + to_string(batch.arena.Used()) + " bytes in the arena + "
+                        + to_string(data.BufferBytes()) + " bytes of batch buffers");
+    }
+}
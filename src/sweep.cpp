@@ -0,0 +1,115 @@
+#include "sweep.hpp"
+#include <cstdio>
+#include <fstream>
+#include "common.hpp"
+#include "splitter.hpp"
+
+using namespace std;
+
+namespace Sweep {
+
+vector<SweepPoint> ReadGrid(const string& file) {
+    ifstream in(file);
+    if (!in) {
+        Utils::Error("failed to open the sweep grid " + file);
+    }
+    vector<SweepPoint> grid;
+    string line;
+    size_t line_no = 0;
+    while (getline(in, line)) {
+        ++line_no;
+        vector<StringView> fields;
+        for (auto f : Utils::Tokenize(StringView(line), ' ')) {
+            for (auto g : Utils::Tokenize(f, '\t')) {
+                if (!g.empty()) fields.push_back(g);
+            }
+        }
+        if (fields.empty() || fields.front()[0] == '#') continue;
+        SweepPoint p;
+        if (fields.size() != 3
+            || !Utils::StringViewTo(fields[0], p.min_sw_score)
+            || !Utils::StringViewTo(fields[1], p.min_sw_diff)
+            || !Utils::StringViewTo(fields[2], p.min_len)) {
+            Utils::Error(file + ":" + to_string(line_no) + ": expected \"-m -f -l\", got \"" + line + "\"");
+        }
+        grid.push_back(p);
+    }
+    if (grid.empty()) {
+        Utils::Error("the sweep grid " + file + " has no combinations");
+    }
+    return grid;
+}
+
+void Evaluate(const vector<SweepPoint>& grid
+              , const SidecarRow *rows
+              , size_t n
+              , const size_t *excluded
+              , size_t num_excluded
+              , vector<SweepStats>& stats) {
+    for (size_t g = 0; g < grid.size(); ++g) {
+        const auto& p = grid[g];
+        auto& s = stats[g];
+        s.reads += n - num_excluded;
+        size_t next_excluded = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (next_excluded < num_excluded && excluded[next_excluded] == i) {
+                ++next_excluded;
+                continue;
+            }
+            const auto& r = rows[i];
+            if (r.sw_score < p.min_sw_score) {
+                ++s.no_adapter;
+                continue;
+            }
+            if (r.sw_score - r.sw_score_next_best < p.min_sw_diff) {
+                ++s.ambiguous;
+                continue;
+            }
+            // the same two segments BamSplitter::Build() cuts
+            uint64_t segments = 0;
+            if (r.ref_begin > p.min_len) {
+                ++segments;
+                s.bases_kept += r.ref_begin;
+            }
+            if (r.qs + r.ref_end + 1 + p.min_len < r.qe) {
+                ++segments;
+                s.bases_kept += r.qe - r.qs - r.ref_end - 1;
+            }
+            s.segments += segments;
+            if (segments) {
+                ++s.split;
+            } else {
+                ++s.too_short;
+            }
+        }
+    }
+}
+
+void Add(const vector<SweepStats>& from, vector<SweepStats>& to) {
+    for (size_t g = 0; g < from.size(); ++g) {
+        to[g].reads += from[g].reads;
+        to[g].no_adapter += from[g].no_adapter;
+        to[g].ambiguous += from[g].ambiguous;
+        to[g].too_short += from[g].too_short;
+        to[g].split += from[g].split;
+        to[g].segments += from[g].segments;
+        to[g].bases_kept += from[g].bases_kept;
+    }
+}
+
+void WriteReport(const string& file, const vector<SweepPoint>& grid, const vector<SweepStats>& stats) {
+    ofstream out(file);
+    out << "min_sw_score\tmin_sw_diff\tmin_len\treads\tno_adapter\tambiguous\ttoo_short\tsplit\tsegments\tbases_kept\n";
+    for (size_t g = 0; g < grid.size(); ++g) {
+        const auto& p = grid[g];
+        const auto& s = stats[g];
+        out << p.min_sw_score << '\t' << p.min_sw_diff << '\t' << p.min_len << '\t'
+            << s.reads << '\t' << s.no_adapter << '\t' << s.ambiguous << '\t' << s.too_short << '\t'
+            << s.split << '\t' << s.segments << '\t' << s.bases_kept << '\n';
+    }
+    if (!out) {
+        Utils::Error("failed to write the sweep report " + file);
+    }
+}
+
+}
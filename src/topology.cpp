@@ -0,0 +1,113 @@
+#include "topology.hpp"
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <pthread.h>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include "common.hpp"
+
+using namespace std;
+
+namespace {
+
+// "0-3,8,10-11" as in sysfs cpulist files
+vector<int> ParseCpuList(const string& line) {
+    vector<int> cpus;
+    for (const auto& range : Utils::Tokenize(line, ',')) {
+        auto bounds = Utils::Tokenize(range, '-');
+        int first, last;
+        if (!Utils::StringViewTo(bounds[0], first)) continue;
+        if (bounds.size() < 2 || !Utils::StringViewTo(bounds[1], last)) last = first;
+        for (int c = first; c <= last; ++c) {
+            cpus.push_back(c);
+        }
+    }
+    return cpus;
+}
+
+bool ReadFirstLine(const string& path, string& line) {
+    ifstream in(path);
+    return in && getline(in, line) && !line.empty();
+}
+
+}
+
+CpuTopology CpuTopology::Detect() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        for (int c = 0; c < CPU_SETSIZE; ++c) CPU_SET(c, &allowed);
+    }
+    CpuTopology topology;
+    string line;
+    // node ids can have holes, stop after a run of missing ones
+    for (int id = 0, missing = 0; missing < 64; ++id) {
+        if (!ReadFirstLine("/sys/devices/system/node/node" + to_string(id) + "/cpulist", line)) {
+            ++missing;
+            continue;
+        }
+        missing = 0;
+        vector<int> cpus;
+        for (int c : ParseCpuList(line)) {
+            if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed)) cpus.push_back(c);
+        }
+        if (cpus.empty()) continue;
+        topology.cpus_.push_back(move(cpus));
+        topology.node_ids_.push_back(id);
+    }
+    if (topology.cpus_.empty()) {
+        vector<int> cpus;
+        for (int c = 0; c < CPU_SETSIZE; ++c) {
+            if (CPU_ISSET(c, &allowed)) cpus.push_back(c);
+        }
+        topology.cpus_.push_back(move(cpus));
+        topology.node_ids_.push_back(0);
+    }
+    return topology;
+}
+
+size_t CpuTopology::NodeOfPath(const string& path) const {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        auto slash = path.rfind('/');
+        if (stat(slash == string::npos ? "." : path.substr(0, slash + 1).c_str(), &st) != 0) return 0;
+    }
+    // /sys/dev/block/MAJ:MIN links to the partition or disk; the numa_node file sits on the
+    // device (nvme controller, pci function, ...) somewhere above it
+    char resolved[PATH_MAX];
+    auto link = "/sys/dev/block/" + to_string(major(st.st_dev)) + ":" + to_string(minor(st.st_dev));
+    if (realpath(link.c_str(), resolved) == nullptr) return 0;
+    string dir = resolved;
+    string line;
+    while (dir.size() > string("/sys/devices").size()) {
+        if (ReadFirstLine(dir + "/device/numa_node", line) || ReadFirstLine(dir + "/numa_node", line)) {
+            int id;
+            if (!Utils::StringViewTo(StringView(line), id) || id < 0) return 0;
+            for (size_t n = 0; n < node_ids_.size(); ++n) {
+                if (node_ids_[n] == id) return n;
+            }
+            return 0;
+        }
+        dir.erase(dir.rfind('/'));
+    }
+    return 0;
+}
+
+string CpuTopology::ToString() const {
+    string s;
+    for (size_t n = 0; n < cpus_.size(); ++n) {
+        if (n) s += ", ";
+        s += "node" + to_string(node_ids_[n]) + ": " + to_string(cpus_[n].size()) + " cpus";
+    }
+    return s;
+}
+
+bool PinCurrentThread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <htslib/bgzf.h>
+#include <htslib/sam.h>
+#include <pbbam/BamHeader.h>
+#include <pbbam/BamRecord.h>
+#include <pbbam/BamWriter.h>
+#include <pbbam/PbiBuilder.h>
+#include <pbbam/PbiRawData.h>
+#include "merge.hpp"
+
+using namespace std;
+using namespace PacBio::BAM;
+
+namespace {
+
+const char kMovie[] = "m54006_170729_232022";
+constexpr int32_t kReadLength = 500;
+
+string ReadName(int32_t zmw) {
+    return string(kMovie) + "/" + to_string(zmw) + "/0_" + to_string(kReadLength);
+}
+
+BamHeader Header() {
+    auto id = ReadGroupInfo::MakeReadGroupId(kMovie, "SUBREAD");
+    return BamHeader("@HD\tVN:1.5\tSO:unknown\tpb:3.0.1\n"
+                     "@RG\tID:" + id + "\tPL:PACBIO\tPU:" + kMovie + "\t"
+                     "DS:READTYPE=SUBREAD;BINDINGKIT=100-862-200;SEQUENCINGKIT=100-861-800;"
+                     "BASECALLERVERSION=5.0.0;FRAMERATEHZ=80.000000\n");
+}
+
+// @n subreads of one ZMW each, from @first_zmw on, written and indexed the way the split writes them
+void WriteShard(const string& file, int32_t first_zmw, int32_t n) {
+    auto header = Header();
+    auto rg = ReadGroupInfo::MakeReadGroupId(kMovie, "SUBREAD");
+    BamWriter writer(file, header, BamWriter::CompressionLevel_1, 1, BamWriter::BinCalculation_OFF, false);
+    PbiBuilder index(file + ".pbi");
+    // varied enough that the records do not all compress into a single block
+    uint32_t state = static_cast<uint32_t>(first_zmw) * 2654435761u + 1;
+    for (int32_t zmw = first_zmw; zmw < first_zmw + n; ++zmw) {
+        string seq(kReadLength, 'A');
+        for (auto& c : seq) {
+            state = state * 1103515245u + 12345u;
+            c = "ACGT"[(state >> 16) & 3];
+        }
+        BamRecord record(header);
+        auto& impl = record.Impl();
+        impl.Name(ReadName(zmw));
+        impl.SetMapped(false);
+        impl.SetSequenceAndQualities(seq);
+        impl.AddTag("RG", Tag(rg));
+        impl.AddTag("zm", Tag(zmw));
+        impl.AddTag("qs", Tag(int32_t(0)));
+        impl.AddTag("qe", Tag(kReadLength));
+        impl.AddTag("np", Tag(int32_t(1)));
+        impl.AddTag("rq", Tag(0.8f));
+        impl.AddTag("cx", Tag(uint8_t(3)));
+        int64_t offset;
+        writer.Write(record, &offset);
+        index.AddRecord(record, offset);
+    }
+    index.Close();
+}
+
+// the name of the record at virtual offset @offset of @file
+string NameAt(const string& file, int64_t offset) {
+    BGZF *fp = bgzf_open(file.c_str(), "r");
+    EXPECT_NE(nullptr, fp);
+    if (fp == nullptr) return string();
+    bam1_t *b = bam_init1();
+    string name;
+    if (bgzf_seek(fp, offset, SEEK_SET) == 0 && bam_read1(fp, b) >= 0) {
+        name = bam_get_qname(b);
+    }
+    bam_destroy1(b);
+    bgzf_close(fp);
+    return name;
+}
+
+class MergeTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char dir[] = "/tmp/merge_test_XXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(dir));
+        dir_ = dir;
+    }
+
+    void TearDown() override {
+        for (const auto& f : files_) unlink(f.c_str());
+        rmdir(dir_.c_str());
+    }
+
+    string File(const string& name) {
+        auto file = dir_ + "/" + name;
+        files_.push_back(file);
+        files_.push_back(file + ".pbi");
+        return file;
+    }
+
+    string dir_;
+    vector<string> files_;
+};
+
+}
+
+TEST_F(MergeTest, IndexPointsIntoEveryShard) {
+    // the first shard spans many BGZF blocks, so a wrong base for the second one shows
+    const int32_t sizes[] = {2000, 300, 700};
+    vector<string> shards;
+    int32_t zmw = 0;
+    for (size_t i = 0; i < 3; ++i) {
+        shards.push_back(File("shard" + to_string(i) + ".bam"));
+        WriteShard(shards.back(), zmw, sizes[i]);
+        zmw += sizes[i];
+    }
+    auto merged = File("merged.bam");
+    MergeBams(shards, merged, true);
+
+    PbiRawData index(merged + ".pbi");
+    const auto& basic = index.BasicData();
+    ASSERT_EQ(static_cast<size_t>(zmw), basic.fileOffset_.size());
+    size_t first = 0;
+    for (auto size : sizes) {
+        // the first and the last record of every shard
+        for (auto i : {first, first + size - 1}) {
+            EXPECT_EQ(static_cast<int32_t>(i), basic.holeNumber_[i]);
+            EXPECT_EQ(ReadName(static_cast<int32_t>(i)), NameAt(merged, basic.fileOffset_[i])) << "record " << i;
+        }
+        first += size;
+    }
+}
@@ -0,0 +1,115 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "common.hpp"
+#include "read_name.hpp"
+
+using namespace std;
+
+namespace {
+
+const char kMovie[] = "m54006_170729_232022";
+
+}
+
+TEST(ReadName, SubreadRoundTrip) {
+    SubreadNameFormatter formatter;
+    auto name = formatter.Format(kMovie, 4194368, 0, 12345);
+    EXPECT_EQ(string(kMovie) + "/4194368/0_12345", name.to_string());
+    SubreadName parsed;
+    ASSERT_TRUE(ParseSubreadName(name, parsed));
+    EXPECT_EQ(kMovie, parsed.movie.to_string());
+    EXPECT_EQ(4194368, parsed.zmw);
+    EXPECT_EQ(0, parsed.qs);
+    EXPECT_EQ(12345, parsed.qe);
+    EXPECT_TRUE(parsed.ccs.empty());
+}
+
+TEST(ReadName, CcsRoundTrip) {
+    SubreadNameFormatter formatter;
+    for (string ccs : {"ccs", "ccs/fwd", "ccs/rev"}) {
+        SubreadName parsed;
+        auto input = string(kMovie) + "/42/" + ccs;
+        ASSERT_TRUE(ParseSubreadName(input, parsed)) << input;
+        EXPECT_EQ(42, parsed.zmw);
+        EXPECT_EQ(ccs, parsed.ccs.to_string());
+        auto name = formatter.FormatCcs(parsed.movie, parsed.zmw, parsed.ccs, 10, 200);
+        EXPECT_EQ(input + "/10_200", name.to_string());
+    }
+}
+
+TEST(ReadName, RejectsMalformed) {
+    SubreadName parsed;
+    for (string name : {"", "movie", "movie/12", "movie/12/", "movie/x/0_10", "movie/12/0-10", "movie/12/0_x"
+                        , "movie/12/ccsx", "movie/99999999999/0_10"}) {
+        EXPECT_FALSE(ParseSubreadName(name, parsed)) << name;
+    }
+}
+
+TEST(ReadName, LongestMovieName) {
+    SubreadNameFormatter formatter;
+    string movie(SubreadNameFormatter::kBufferSize - 36, 'm');
+    auto name = formatter.Format(movie, INT32_MIN, INT32_MIN, INT32_MIN);
+    EXPECT_EQ(SubreadNameFormatter::kBufferSize, name.size());
+    EXPECT_EQ(movie + "/-2147483648/-2147483648_-2147483648", name.to_string());
+}
+
+TEST(ReadNameDeathTest, TooLongMovieName) {
+    SubreadNameFormatter formatter;
+    string movie(SubreadNameFormatter::kBufferSize - 35, 'm');
+    EXPECT_EXIT(formatter.Format(movie, 1, 0, 10), ::testing::ExitedWithCode(EXIT_FAILURE), "too long");
+    EXPECT_EXIT(formatter.FormatCcs(movie, 1, "ccs", 0, 10), ::testing::ExitedWithCode(EXIT_FAILURE), "too long");
+}
+
+TEST(StringViewTo, RejectsOverflow) {
+    uint16_t u16;
+    EXPECT_TRUE(Utils::StringViewTo(StringView("65535"), u16));
+    EXPECT_EQ(65535, u16);
+    EXPECT_FALSE(Utils::StringViewTo(StringView("65536"), u16));
+    EXPECT_FALSE(Utils::StringViewTo(StringView("70000"), u16));
+    EXPECT_FALSE(Utils::StringViewTo(StringView("-1"), u16));
+    uint8_t u8;
+    EXPECT_TRUE(Utils::StringViewTo(StringView("255"), u8));
+    EXPECT_FALSE(Utils::StringViewTo(StringView("256"), u8));
+    int32_t i32;
+    EXPECT_TRUE(Utils::StringViewTo(StringView("-2147483648"), i32));
+    EXPECT_EQ(INT32_MIN, i32);
+    EXPECT_TRUE(Utils::StringViewTo(StringView("2147483647"), i32));
+    EXPECT_EQ(INT32_MAX, i32);
+    EXPECT_FALSE(Utils::StringViewTo(StringView("2147483648"), i32));
+    EXPECT_FALSE(Utils::StringViewTo(StringView("-2147483649"), i32));
+    uint64_t u64;
+    EXPECT_TRUE(Utils::StringViewTo(StringView("18446744073709551615"), u64));
+    EXPECT_EQ(UINT64_MAX, u64);
+    EXPECT_FALSE(Utils::StringViewTo(StringView("18446744073709551616"), u64));
+}
+
+// not a pass/fail test: reports the time per name, parsed and formatted again the way Build() does
+TEST(ReadNameBenchmark, ParseAndFormat) {
+    constexpr size_t kNames = 4096;
+    constexpr size_t kRounds = 256;
+    vector<string> names;
+    SubreadNameFormatter formatter;
+    for (size_t i = 0; i < kNames; ++i) {
+        auto qs = static_cast<int32_t>(i * 37 % 20000);
+        names.push_back(formatter.Format(kMovie, static_cast<int32_t>(i * 131), qs, qs + 15000).to_string());
+    }
+    size_t checksum = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t round = 0; round < kRounds; ++round) {
+        for (const auto& name : names) {
+            SubreadName parsed;
+            ParseSubreadName(name, parsed);
+            checksum += formatter.Format(parsed.movie, parsed.zmw, parsed.qs, parsed.qs + 100).size();
+            checksum += formatter.Format(parsed.movie, parsed.zmw, parsed.qe - 100, parsed.qe).size();
+        }
+    }
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    ns /= kNames * kRounds;
+    cout << "[ benchmark ] parse + 2 x format: " << ns << " ns per name" << endl;
+    RecordProperty("ns_per_name", to_string(ns));
+    EXPECT_GT(checksum, 0u);
+}
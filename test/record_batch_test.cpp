@@ -0,0 +1,75 @@
+#include <cstdint>
+#include <string>
+#include <gtest/gtest.h>
+#include <pbbam/BamHeader.h>
+#include <pbbam/BamRecord.h>
+#include "record_batch.hpp"
+
+using namespace std;
+using namespace PacBio::BAM;
+
+namespace {
+
+const char kMovie[] = "m54006_170729_232022";
+
+BamHeader Header(const string& read_type) {
+    auto id = ReadGroupInfo::MakeReadGroupId(kMovie, read_type);
+    return BamHeader("@HD\tVN:1.5\tSO:unknown\tpb:3.0.1\n"
+                     "@RG\tID:" + id + "\tPL:PACBIO\tPU:" + kMovie + "\t"
+                     "DS:READTYPE=" + read_type + ";BINDINGKIT=100-862-200;SEQUENCINGKIT=100-861-800;"
+                     "BASECALLERVERSION=5.0.0;FRAMERATEHZ=80.000000\n");
+}
+
+// a record named @name whose tags say zmw 7, 10_20, in a read group of @read_type
+BamRecord Record(const string& name, const string& read_type) {
+    BamRecord record(Header(read_type));
+    auto& impl = record.Impl();
+    impl.Name(name);
+    impl.SetSequenceAndQualities("ACGTACGTAC");
+    impl.AddTag("RG", Tag(ReadGroupInfo::MakeReadGroupId(kMovie, read_type)));
+    impl.AddTag("zm", Tag(int32_t(7)));
+    impl.AddTag("qs", Tag(int32_t(10)));
+    impl.AddTag("qe", Tag(int32_t(20)));
+    return record;
+}
+
+}
+
+TEST(RecordBatch, SubreadsDecodeFromTheirTags) {
+    RecordBatch<BamRecord> data;
+    // the name disagrees with the tags, so that it shows which one was read
+    data.push_back(Record(string(kMovie) + "/8/0_10", "SUBREAD"));
+    data.push_back(Record(string(kMovie) + "/9/0_10", "SUBREAD"));
+    data.Decode();
+    for (size_t i = 0; i < 2; ++i) {
+        const auto& meta = data.Metadata(i);
+        EXPECT_TRUE(meta.parsed);
+        EXPECT_TRUE(meta.from_tags);
+        EXPECT_EQ(kMovie, meta.name.movie.to_string());
+        EXPECT_EQ(7, meta.name.zmw);
+        EXPECT_EQ(10, meta.name.qs);
+        EXPECT_EQ(20, meta.name.qe);
+        EXPECT_TRUE(meta.name.ccs.empty());
+    }
+    EXPECT_EQ("ACGTACGTAC", data.Sequence(1).to_string());
+}
+
+TEST(RecordBatch, CcsReadsAndUntaggedReadsParseTheirName) {
+    RecordBatch<BamRecord> data;
+    data.push_back(Record(string(kMovie) + "/8/ccs", "CCS"));
+    BamRecord untagged;
+    untagged.Impl().Name(string(kMovie) + "/9/0_10");
+    untagged.Impl().SetSequenceAndQualities("ACGTACGTAC");
+    data.push_back(move(untagged));
+    data.Decode();
+    const auto& ccs = data.Metadata(0);
+    EXPECT_FALSE(ccs.from_tags);
+    ASSERT_TRUE(ccs.parsed);
+    EXPECT_EQ(8, ccs.name.zmw);
+    EXPECT_EQ("ccs", ccs.name.ccs.to_string());
+    const auto& subread = data.Metadata(1);
+    EXPECT_FALSE(subread.from_tags);
+    ASSERT_TRUE(subread.parsed);
+    EXPECT_EQ(9, subread.name.zmw);
+    EXPECT_EQ(kMovie, subread.name.movie.to_string());
+}
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <pbbam/BamRecord.h>
+#include "record_batch.hpp"
+#include "splitter.hpp"
+
+using namespace std;
+using namespace PacBio::BAM;
+
+namespace {
+
+const char kMovie[] = "m54006_170729_232022";
+
+// the score of a pair of bases, the way BamSplitter builds its scoring matrix
+int PairScore(const SplitterOptions& options, char a, char b) {
+    if (a == 'N' && b == 'N') return -options.mismatch_penalty;
+    if (a == 'N' || b == 'N') return options.match_score >> 1;
+    return a == b ? options.match_score : -options.mismatch_penalty;
+}
+
+// the best local alignment score of @primer against @read with affine gaps, by full dynamic
+// programming: a gap of k bases costs the open penalty plus k - 1 extensions
+int BruteForceScore(const SplitterOptions& options, const string& primer, const string& read) {
+    const int open = options.gap_open_penalty;
+    const int ext = options.gap_ext_penalty;
+    const int kNone = -1000000;
+    size_t cols = read.size() + 1;
+    vector<int> h(cols, 0), e(cols, kNone), prev_h(cols, 0);
+    int best = 0;
+    for (size_t i = 1; i <= primer.size(); ++i) {
+        swap(h, prev_h);
+        h[0] = 0;
+        int f = kNone;
+        for (size_t j = 1; j < cols; ++j) {
+            // e: gap in the read, f: gap in the primer
+            e[j] = max(e[j] - ext, prev_h[j] - open);
+            f = max(f - ext, h[j - 1] - open);
+            h[j] = max({0, prev_h[j - 1] + PairScore(options, primer[i - 1], read[j - 1]), e[j], f});
+            best = max(best, h[j]);
+        }
+    }
+    return best;
+}
+
+SplitterOptions Options(const string& primer, uint8_t match_score, uint16_t min_sw_score) {
+    SplitterOptions options = SplitterOptions();
+    options.primer_seq = primer;
+    options.min_sw_score = min_sw_score;
+    options.match_score = match_score;
+    options.mismatch_penalty = 2;
+    options.gap_open_penalty = 3;
+    options.gap_ext_penalty = 1;
+    options.format = OutputFormat::BAM;
+    return options;
+}
+
+}
+
+TEST(Triage, CompositionNeverRejectsAHitScoringM) {
+    // primers with and without Ns, reads over few letters so that the bound gets close
+    const vector<string> primers = {"AACCGGTT", "ACGTNNACGT", "NACGTTGCAN", "GATTACA"};
+    const vector<string> alphabets = {"ACGT", "ACGTN", "AC", "ACN", "GTN", "AN"};
+    uint32_t state = 12345;
+    auto next = [&state]() {
+        state = state * 1103515245u + 12345u;
+        return state >> 16;
+    };
+    uint64_t triaged = 0, checked = 0;
+    for (const auto& primer : primers) {
+        for (uint8_t match_score : {2, 3}) {
+            for (uint16_t min_sw_score = 4; min_sw_score <= match_score * primer.size(); ++min_sw_score) {
+                auto options = Options(primer, match_score, min_sw_score);
+                BamSplitter splitter(options);
+                RecordBatch<BamRecord> data;
+                vector<string> reads;
+                for (size_t k = 0; k < 64; ++k) {
+                    const auto& alphabet = alphabets[next() % alphabets.size()];
+                    string read(options.min_len + 1 + (min_sw_score + match_score - 1) / match_score + next() % 24, 'A');
+                    for (auto& c : read) {
+                        c = alphabet[next() % alphabet.size()];
+                    }
+                    if (k % 4 == 0) {
+                        // the primer itself, its Ns filled in from the alphabet
+                        auto hit = primer;
+                        for (auto& c : hit) {
+                            if (c == 'N') c = alphabet[next() % alphabet.size()];
+                        }
+                        read.replace(next() % (read.size() - min(read.size(), hit.size()) + 1), hit.size(), hit);
+                    }
+                    BamRecord record;
+                    record.Impl().Name(string(kMovie) + "/" + to_string(k) + "/0_" + to_string(read.size()));
+                    record.Impl().SetSequenceAndQualities(read);
+                    data.push_back(move(record));
+                    reads.push_back(read);
+                }
+                data.Decode();
+                for (size_t k = 0; k < reads.size(); ++k) {
+                    auto rule = splitter.Triage(data, k, true);
+                    EXPECT_NE(TRIAGE_LENGTH, rule) << reads[k];
+                    if (rule != TRIAGE_COMPOSITION) continue;
+                    ++triaged;
+                    EXPECT_LT(BruteForceScore(options, primer, reads[k]), min_sw_score)
+                        << "primer " << primer << ", read " << reads[k] << ", -M " << int(match_score);
+                }
+                checked += reads.size();
+            }
+        }
+    }
+    // the rule has to fire for the comparison to mean anything
+    EXPECT_GT(triaged, checked / 20);
+}
+
+TEST(Triage, LengthLeavesRoomForAHitAndASegment) {
+    auto options = Options("ACGTACGT", 2, 12);
+    options.min_len = 5;
+    BamSplitter splitter(options);
+    RecordBatch<BamRecord> data;
+    // a hit scoring 12 spans at least 6 bases, and a segment needs more than 5 more
+    for (size_t length : {11, 12}) {
+        BamRecord record;
+        record.Impl().Name(string(kMovie) + "/" + to_string(length) + "/0_" + to_string(length));
+        record.Impl().SetSequenceAndQualities(string("ACGTACGTACGT").substr(0, length));
+        data.push_back(move(record));
+    }
+    data.Decode();
+    EXPECT_EQ(TRIAGE_LENGTH, splitter.Triage(data, 0, true));
+    EXPECT_EQ(NUM_TRIAGE_RULES, splitter.Triage(data, 1, true));
+}
+
+TEST(Triage, MinRqAppliesWithoutBounds) {
+    auto options = Options("ACGTACGT", 2, 12);
+    options.min_rq = 0.99f;
+    BamSplitter splitter(options);
+    RecordBatch<BamRecord> data;
+    // a long read below --min-rq, and a short one without any hit
+    const float rqs[] = {0.5f, 0.999f};
+    const string seqs[] = {"ACGTACGTACGTACGTACGT", "AC"};
+    for (size_t k = 0; k < 2; ++k) {
+        BamRecord record;
+        record.Impl().Name(string(kMovie) + "/" + to_string(k) + "/0_" + to_string(seqs[k].size()));
+        record.Impl().SetSequenceAndQualities(seqs[k]);
+        record.Impl().AddTag("rq", Tag(rqs[k]));
+        data.push_back(move(record));
+    }
+    data.Decode();
+    EXPECT_EQ(TRIAGE_RQ, splitter.Triage(data, 0, true));
+    EXPECT_EQ(TRIAGE_RQ, splitter.Triage(data, 0, false));
+    EXPECT_EQ(TRIAGE_LENGTH, splitter.Triage(data, 1, true));
+    EXPECT_EQ(NUM_TRIAGE_RULES, splitter.Triage(data, 1, false));
+}
+
+TEST(Triage, ByZmwBoundsFollowTheRescue) {
+    // 14 is below -m but above the 3/4 of it a sibling's strong hit rescues
+    const string read = "ACGTACGG";
+    auto options = Options("ACGTACGT", 2, 16);
+    auto by_zmw = options;
+    by_zmw.by_zmw = true;
+    BamSplitter splitter(options);
+    BamSplitter zmw_splitter(by_zmw);
+    RecordBatch<BamRecord> data;
+    BamRecord record;
+    record.Impl().Name(string(kMovie) + "/1/0_" + to_string(read.size()));
+    record.Impl().SetSequenceAndQualities(read);
+    data.push_back(move(record));
+    data.Decode();
+    EXPECT_EQ(TRIAGE_LENGTH, splitter.Triage(data, 0, true));
+    EXPECT_EQ(NUM_TRIAGE_RULES, zmw_splitter.Triage(data, 0, true));
+}
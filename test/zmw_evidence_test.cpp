@@ -0,0 +1,102 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <pbbam/BamRecord.h>
+#include "splitter.hpp"
+
+using namespace std;
+using namespace PacBio::BAM;
+
+namespace {
+
+const char kMovie[] = "m54006_170729_232022";
+// G and T only, against flanks of A and C only, so the flanks score nothing
+const char kPrimer[] = "GTTGGTGTGGTTGTGGTGTT";
+
+string Flank(size_t n, uint32_t seed) {
+    string flank(n, 'A');
+    for (auto& c : flank) {
+        seed = seed * 1103515245u + 12345u;
+        c = "AC"[(seed >> 16) & 1];
+    }
+    return flank;
+}
+
+// the primer with a mismatch every 5 bases, @n of them
+string Mutated(size_t n) {
+    string primer = kPrimer;
+    for (size_t k = 1; k <= n; ++k) {
+        primer[5 * k] = 'A';
+    }
+    return primer;
+}
+
+SplitterOptions Options() {
+    SplitterOptions options = SplitterOptions();
+    options.primer_seq = kPrimer;
+    options.min_sw_score = 30; // of 40 for the whole primer
+    options.min_sw_diff = 5;
+    options.match_score = 2;
+    options.mismatch_penalty = 2;
+    options.gap_open_penalty = 3;
+    options.gap_ext_penalty = 1;
+    options.min_len = 10;
+    options.by_zmw = true;
+    options.format = OutputFormat::BAM;
+    options.keep_category[AMBIGUOUS] = true;
+    return options;
+}
+
+void Add(Batch& batch, int32_t zmw, const string& seq) {
+    BamRecord record;
+    record.Impl().Name(string(kMovie) + "/" + to_string(zmw) + "/0_" + to_string(seq.size()));
+    record.Impl().SetSequenceAndQualities(seq);
+    batch.records.push_back(move(record));
+}
+
+}
+
+TEST(ZmwEvidence, WindowRescueAndAmbiguity) {
+    auto options = Options();
+    BamSplitter splitter(options);
+    Batch batch;
+    // a strong hit at 100 that the following subreads of the ZMW can lean on
+    Add(batch, 7, Flank(100, 1) + kPrimer + Flank(100, 2));
+    // a second adapter outside the window is not seen: only the window is tested for -f
+    Add(batch, 7, Flank(100, 3) + kPrimer + Flank(200, 4) + kPrimer + Flank(50, 5));
+    // 28 is below -m, but above 3/4 of it and 6 apart from the next-best: rescued
+    Add(batch, 7, Flank(100, 6) + Mutated(3) + Flank(100, 7));
+    // too short for the window; 40 against a next-best of 36 fails -f and is no rescue either
+    Add(batch, 7, Mutated(1) + Flank(80, 8) + kPrimer + Flank(10, 9));
+    batch.records.Decode();
+    splitter.Align(batch);
+
+    ASSERT_EQ(3u, batch.hits.size());
+    for (size_t i = 0; i < 3; ++i) {
+        EXPECT_EQ(i, batch.hits[i].index);
+        EXPECT_EQ(100, batch.hits[i].ref_begin) << "read " << i;
+    }
+    EXPECT_EQ(40, batch.hits[1].sw_score);
+    EXPECT_EQ(28, batch.hits[2].sw_score);
+    EXPECT_EQ(1u, batch.window_hits);
+    EXPECT_EQ(1u, batch.rescued);
+    ASSERT_EQ(1u, batch.rejected.size());
+    EXPECT_EQ(3u, batch.rejected[0].index);
+    EXPECT_EQ(AMBIGUOUS, batch.rejected[0].category);
+}
+
+TEST(ZmwEvidence, WithoutASiblingTheWholeReadDecides) {
+    auto options = Options();
+    BamSplitter splitter(options);
+    Batch batch;
+    // the second read of the test above, alone in its ZMW
+    Add(batch, 8, Flank(100, 3) + kPrimer + Flank(200, 4) + kPrimer + Flank(50, 5));
+    batch.records.Decode();
+    splitter.Align(batch);
+
+    EXPECT_TRUE(batch.hits.empty());
+    ASSERT_EQ(1u, batch.rejected.size());
+    EXPECT_EQ(AMBIGUOUS, batch.rejected[0].category);
+    EXPECT_EQ(0u, batch.window_hits);
+}